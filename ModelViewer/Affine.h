@@ -0,0 +1,72 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+// Affine transform stored as the first three rows of its matrix, the fourth row is always 0 0 0 1. Bone transforms
+// use it from sampling to the shaders: 48 instead of 64 bytes per bone and no multiplications with the constant row.
+struct Affine
+{
+    glm::vec4 rows[3];
+
+    Affine() : rows{ glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f) } {}
+    Affine(const glm::vec4& r0, const glm::vec4& r1, const glm::vec4& r2) : rows{ r0, r1, r2 } {}
+    // drops the fourth row of m, which has to be 0 0 0 1
+    explicit Affine(const glm::mat4& m)
+    {
+        for (int r = 0; r < 3; ++r) rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    }
+
+    // translation * rotation * scale
+    static Affine FromTRS(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        glm::mat3 r = glm::mat3_cast(rotation);
+        return Affine(glm::vec4(r[0][0] * scale.x, r[1][0] * scale.y, r[2][0] * scale.z, position.x),
+                      glm::vec4(r[0][1] * scale.x, r[1][1] * scale.y, r[2][1] * scale.z, position.y),
+                      glm::vec4(r[0][2] * scale.x, r[1][2] * scale.y, r[2][2] * scale.z, position.z));
+    }
+
+    glm::mat4 ToMat4() const { return glm::transpose(glm::mat4(rows[0], rows[1], rows[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))); }
+    glm::vec3 GetColumn(int c) const { return glm::vec3(rows[0][c], rows[1][c], rows[2][c]); }
+
+    bool operator==(const Affine& other) const { return rows[0] == other.rows[0] && rows[1] == other.rows[1] && rows[2] == other.rows[2]; }
+};
+
+// 36 multiplies instead of the 64 of a mat4 product
+inline Affine operator*(const Affine& a, const Affine& b)
+{
+    Affine result;
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    // every row of the result is a combination of the rows of b, plus the translation of a in the last lane
+    __m128 b0 = _mm_loadu_ps(&b.rows[0].x), b1 = _mm_loadu_ps(&b.rows[1].x), b2 = _mm_loadu_ps(&b.rows[2].x);
+    __m128 lastLane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    for (int r = 0; r < 3; ++r)
+    {
+        __m128 row = _mm_loadu_ps(&a.rows[r].x);
+        __m128 sum = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(row, row, 0x00), b0), _mm_mul_ps(_mm_shuffle_ps(row, row, 0x55), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, 0xAA), b2));
+        _mm_storeu_ps(&result.rows[r].x, _mm_add_ps(sum, _mm_and_ps(row, lastLane)));
+    }
+#else
+    for (int r = 0; r < 3; ++r)
+    {
+        const glm::vec4& row = a.rows[r];
+        result.rows[r] = row.x * b.rows[0] + row.y * b.rows[1] + row.z * b.rows[2] + glm::vec4(0.0f, 0.0f, 0.0f, row.w);
+    }
+#endif
+    return result;
+}
+
+// componentwise blend, used between poses of nearby times
+inline Affine Mix(const Affine& a, const Affine& b, float t)
+{
+    return Affine(glm::mix(a.rows[0], b.rows[0], t), glm::mix(a.rows[1], b.rows[1], t), glm::mix(a.rows[2], b.rows[2], t));
+}
+
+#endif
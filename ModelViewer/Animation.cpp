@@ -1,6 +1,9 @@
 #include "Animation.h"
 
-Bone* Animation::FindBone(const std::string& name)
+#include <algorithm>
+#include <climits>
+
+const Bone* Animation::FindBone(const std::string& name) const
 {
 	auto iter = std::find_if(m_Bones.begin(), m_Bones.end(),
 		[&](const Bone& Bone)
@@ -12,24 +15,86 @@ Bone* Animation::FindBone(const std::string& name)
 	else return &(*iter);
 }
 
-void Animation::ReadMissingBones(const aiAnimation* animation, Model& model)
+void Animation::Load(const aiAnimation* animation, const aiNode* rootNode, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount)
 {
-	int size = animation->mNumChannels;
+	m_Duration = animation->mDuration;
+	m_TicksPerSecond = animation->mTicksPerSecond;
+	ReadHierarchyData(m_RootNode, rootNode);
+	ReadMissingBones(animation, boneInfoMap, boneCount);
 
-	auto& boneInfoMap = model.GetBoneInfoMap();//getting m_BoneInfoMap from Model class
-	int& boneCount = model.GetBoneCount(); //getting the m_BoneCounter from Model class
+	// names are resolved once here, the animator only walks the flat array
+	m_Skeleton.clear();
+	m_NodeNames.clear();
+	FlattenHierarchy(m_RootNode, -1, 0);
+	PruneSkeleton();
+	SortChannelsByDepth();
 
-	//reading channels(bones engaged in an animation and their keyframes)
-	for (int i = 0; i < size; i++)
+	m_ChannelNodes.assign(m_Bones.size(), -1);
+	m_RestPose.Resize(static_cast<int>(m_Skeleton.size()));
+	for (unsigned int i = 0; i < m_Skeleton.size(); ++i)
 	{
-		auto channel = animation->mChannels[i];
-		std::string boneName = channel->mNodeName.data;
+		if (m_Skeleton[i].channel >= 0) m_ChannelNodes[m_Skeleton[i].channel] = i;
+		m_RestPose.SetTransform(i, m_Skeleton[i].transformation);
+	}
+
+	BuildSampledClip();
+}
+
+ClipCompressionReport Animation::Compress(const ClipCompressionSettings& settings)
+{
+	PROFILE_FUNCTION();
+
+	ClipCompressionReport report;
+	if (m_Compressed) return report;
+
+	for (unsigned int i = 0; i < m_Bones.size(); ++i)
+		m_Bones[i].Compress(settings, report);
+
+	// a dense resample would cost more than the packed keys save and add its own error on top of the tolerance
+	report.bytesBefore += m_SampledClip.GetMemory();
+	m_SampledClip.Clear();
+	m_Compressed = true;
+	return report;
+}
+
+void Animation::BuildSampledClip()
+{
+	// assimp reports 0 when the file doesn't say
+	float ticksPerSecond = m_TicksPerSecond > 0 ? static_cast<float>(m_TicksPerSecond) : 25.0f;
+
+	// as dense as the densest track, between 30 and 120 samples per second
+	float rate = 30.0f / ticksPerSecond;
+	for (unsigned int i = 0; i < m_Bones.size(); ++i)
+	{
+		float span = m_Bones[i].GetLastTime() - m_Bones[i].GetFirstTime();
+		if (span > 0.0f) rate = glm::max(rate, (m_Bones[i].GetMaxKeyCount() - 1) / span);
+	}
+	rate = glm::min(rate, 120.0f / ticksPerSecond);
 
+	m_SampledClip.Build(m_Bones, m_Duration, rate);
+}
+
+void Animation::RegisterChannels(const aiAnimation* animation, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount)
+{
+	for (unsigned int i = 0; i < animation->mNumChannels; i++)
+	{
+		std::string boneName = animation->mChannels[i]->mNodeName.data;
 		if (boneInfoMap.find(boneName) == boneInfoMap.end())
 		{
 			boneInfoMap[boneName].id = boneCount;
 			boneCount++;
 		}
+	}
+}
+
+void Animation::ReadMissingBones(const aiAnimation* animation, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount)
+{
+	RegisterChannels(animation, boneInfoMap, boneCount);
+
+	//reading channels(bones engaged in an animation and their keyframes)
+	for (unsigned int i = 0; i < animation->mNumChannels; i++)
+	{
+		auto channel = animation->mChannels[i];
 		m_Bones.push_back(Bone(channel->mNodeName.data,
 			boneInfoMap[channel->mNodeName.data].id, channel));
 	}
@@ -51,4 +116,210 @@ void Animation::ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
 		ReadHierarchyData(newData, src->mChildren[i]);
 		dest.children.push_back(newData);
 	}
-}
\ No newline at end of file
+}
+void Animation::FlattenHierarchy(const AssimpNodeData& node, int parent, int depth)
+{
+	SkeletonNode flat;
+	flat.parent = parent;
+	flat.depth = depth;
+	flat.folded = -1;
+	flat.transformation = Affine(node.transformation);
+
+	const Bone* bone = FindBone(node.name);
+	flat.channel = bone ? static_cast<int>(bone - m_Bones.data()) : -1;
+
+	auto info = m_BoneInfoMap.find(node.name);
+	flat.boneIndex = info != m_BoneInfoMap.end() ? info->second.id : -1;
+	flat.offset = info != m_BoneInfoMap.end() ? Affine(info->second.offset) : Affine();
+
+	int index = static_cast<int>(m_Skeleton.size());
+	m_Skeleton.push_back(flat);
+	m_NodeNames.push_back(node.name);
+
+	for (int i = 0; i < node.childrenCount; i++)
+		FlattenHierarchy(node.children[i], index, depth + 1);
+}
+
+void Animation::PruneSkeleton()
+{
+	int count = static_cast<int>(m_Skeleton.size());
+	m_HierarchyNodeCount = count;
+
+	// a node is needed if it has a bone matrix or one of its descendants has. Children come after their parents,
+	// so walking backwards sees every subtree before its root
+	std::vector<char> needed(count, 0);
+	std::vector<int> neededChildren(count, 0);
+	for (int i = count - 1; i >= 0; --i)
+	{
+		const SkeletonNode& node = m_Skeleton[i];
+		if (node.boneIndex >= 0) needed[i] = 1;
+		if (needed[i] && node.parent >= 0)
+		{
+			needed[node.parent] = 1;
+			neededChildren[node.parent]++;
+		}
+	}
+
+	// static links of a chain (no bone matrix, one needed child) are multiplied into a constant that the next kept
+	// node applies before its own transform. Branching helpers stay, folding them would cost a multiply per child.
+	// Every animated node has a bone id in the model's map, so which nodes fold depends on the model and not on
+	// which of its clips this is
+	std::vector<int> newIndex(count, -1);
+	std::vector<int> chainParent(count, -1);
+	std::vector<Affine> chains(count);
+	std::vector<SkeletonNode> kept;
+	std::vector<std::string> names;
+	m_FoldedTransforms.clear();
+	for (int i = 0; i < count; ++i)
+	{
+		if (!needed[i]) continue;
+		SkeletonNode node = m_Skeleton[i];
+
+		// a needed parent without a new index was folded
+		int parent = node.parent;
+		bool parentFolded = parent >= 0 && newIndex[parent] < 0;
+		int keptParent = parentFolded ? chainParent[parent] : (parent >= 0 ? newIndex[parent] : -1);
+
+		if (node.boneIndex < 0 && neededChildren[i] == 1)
+		{
+			chains[i] = parentFolded ? chains[parent] * node.transformation : node.transformation;
+			chainParent[i] = keptParent;
+			continue;
+		}
+
+		node.parent = keptParent;
+		if (parentFolded)
+		{
+			node.folded = static_cast<int>(m_FoldedTransforms.size());
+			m_FoldedTransforms.push_back(chains[parent]);
+		}
+		newIndex[i] = static_cast<int>(kept.size());
+		kept.push_back(node);
+		names.push_back(m_NodeNames[i]);
+	}
+
+	m_Skeleton.swap(kept);
+	m_NodeNames.swap(names);
+}
+
+void Animation::SortChannelsByDepth()
+{
+	// channels without a node in the hierarchy are never evaluated, they go last
+	int count = static_cast<int>(m_Bones.size());
+	std::vector<int> depths(count, INT_MAX);
+	int maxDepth = 0;
+	for (const SkeletonNode& node : m_Skeleton)
+	{
+		if (node.channel >= 0) depths[node.channel] = node.depth;
+		maxDepth = std::max(maxDepth, node.depth);
+	}
+
+	std::vector<int> order(count);
+	for (int i = 0; i < count; ++i) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return depths[a] < depths[b]; });
+
+	std::vector<Bone> sorted;
+	std::vector<int> newIndex(count);
+	sorted.reserve(count);
+	for (int i = 0; i < count; ++i)
+	{
+		sorted.push_back(std::move(m_Bones[order[i]]));
+		newIndex[order[i]] = i;
+	}
+	m_Bones.swap(sorted);
+	for (SkeletonNode& node : m_Skeleton)
+	{
+		if (node.channel >= 0) node.channel = newIndex[node.channel];
+	}
+
+	m_ChannelsUpToDepth.assign(maxDepth + 1, 0);
+	for (int d = 0; d <= maxDepth; ++d)
+	{
+		for (int i = 0; i < count; ++i) m_ChannelsUpToDepth[d] += depths[i] <= d;
+	}
+}
+
+int Animation::GetChannelCount(int maxDepth) const
+{
+	if (m_ChannelsUpToDepth.empty()) return 0;
+	if (maxDepth < 0 || maxDepth >= static_cast<int>(m_ChannelsUpToDepth.size())) return m_ChannelsUpToDepth.back();
+	return m_ChannelsUpToDepth[maxDepth];
+}
+
+void Animation::SamplePose(float animationTime, Pose& pose, BoneCursor* cursors) const
+{
+	std::copy(m_RestPose.positions.begin(), m_RestPose.positions.end(), pose.positions.begin());
+	std::copy(m_RestPose.rotations.begin(), m_RestPose.rotations.end(), pose.rotations.begin());
+	std::copy(m_RestPose.scales.begin(), m_RestPose.scales.end(), pose.scales.begin());
+
+	if (!m_SampledClip.IsEmpty())
+	{
+		m_SampledClip.Sample(animationTime, m_ChannelNodes.data(), pose);
+		return;
+	}
+
+	// compressed clips decode the keys of every bone
+	for (unsigned int i = 0; i < m_Bones.size(); ++i)
+	{
+		int node = m_ChannelNodes[i];
+		if (node < 0) continue;
+		pose.positions[node] = m_Bones[i].SamplePosition(animationTime, cursors[i].position);
+		pose.rotations[node] = m_Bones[i].SampleRotation(animationTime, cursors[i].rotation);
+		pose.scales[node] = m_Bones[i].SampleScale(animationTime, cursors[i].scale);
+	}
+}
+
+size_t Animation::GetMemory() const
+{
+	size_t bytes = m_Skeleton.size() * sizeof(SkeletonNode) + m_FoldedTransforms.size() * sizeof(Affine) + m_SampledClip.GetMemory() + m_ChannelNodes.size() * sizeof(int) +
+		m_RestPose.GetSize() * (2 * sizeof(glm::vec3) + sizeof(glm::quat)) + m_BoneInfoMap.size() * sizeof(BoneInfo);
+	for (const Bone& bone : m_Bones) bytes += bone.GetMemory();
+	for (const std::string& name : m_NodeNames) bytes += name.capacity();
+	return bytes;
+}
+
+int Animation::FindNode(const std::string& name) const
+{
+	for (unsigned int i = 0; i < m_NodeNames.size(); ++i)
+	{
+		if (m_NodeNames[i] == name) return i;
+	}
+	return -1;
+}
+
+BoneMask Animation::MakeMask(const std::string& rootName, float weight) const
+{
+	BoneMask mask;
+	mask.weights.assign(m_Skeleton.size(), 0.0f);
+
+	// the subtree of a node is the run of deeper nodes right after it in the flattened order
+	int root = FindNode(rootName);
+	if (root >= 0)
+	{
+		mask.weights[root] = weight;
+		for (unsigned int i = root + 1; i < m_Skeleton.size() && m_Skeleton[i].depth > m_Skeleton[root].depth; ++i)
+			mask.weights[i] = weight;
+		return mask;
+	}
+
+	// a pruned node, its kept descendants are found by name in the full hierarchy
+	if (const AssimpNodeData* pruned = FindHierarchyNode(m_RootNode, rootName)) MarkSubtree(*pruned, weight, mask);
+	return mask;
+}
+
+const AssimpNodeData* Animation::FindHierarchyNode(const AssimpNodeData& node, const std::string& name) const
+{
+	if (node.name == name) return &node;
+	for (const AssimpNodeData& child : node.children)
+	{
+		if (const AssimpNodeData* found = FindHierarchyNode(child, name)) return found;
+	}
+	return nullptr;
+}
+
+void Animation::MarkSubtree(const AssimpNodeData& node, float weight, BoneMask& mask) const
+{
+	int index = FindNode(node.name);
+	if (index >= 0) mask.weights[index] = weight;
+	for (const AssimpNodeData& child : node.children) MarkSubtree(child, weight, mask);
+}
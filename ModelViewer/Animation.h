@@ -12,7 +12,11 @@
 
 #include "Bone.h"
 #include "Animdata.h"
+#include "SampledClip.h"
+#include "Pose.h"
+#include "Affine.h"
 #include "Model.h"
+#include "Profiler.h"
 
 struct AssimpNodeData
 {
@@ -22,6 +26,19 @@ struct AssimpNodeData
 	std::vector<AssimpNodeData> children;
 };
 
+// one node of the flattened hierarchy, parents always come before their children. Only nodes some bone matrix
+// depends on are kept, see Animation::PruneSkeleton
+struct SkeletonNode
+{
+	int parent;             // -1 for the root
+	int channel;            // index into the bones of the animation, -1 if the node isn't animated
+	int boneIndex;          // index into the final bone matrices, -1 if no vertex uses the node
+	int depth;              // in the full hierarchy, 0 for the root
+	int folded;             // index into the folded transforms, -1 if no pruned node sits between the node and its parent
+	Affine transformation;
+	Affine offset;
+};
+
 class Animation
 {
 public:
@@ -29,41 +46,108 @@ public:
 
 	Animation(const std::string& animationPath, Model* model)
 	{
+		PROFILE_SCOPE("Animation::Animation");
+
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
 		assert(scene && scene->mRootNode);
 		if (scene->mAnimations == nullptr) throw false;
+		// every take of the file keeps the same nodes, so any of them can blend with this one
+		for (unsigned int i = 0; i < scene->mNumAnimations; ++i)
+			RegisterChannels(scene->mAnimations[i], model->GetBoneInfoMap(), model->GetBoneCount());
 		auto animation = scene->mAnimations[0];
 		m_Duration = animation->mDuration;
 		m_TicksPerSecond = animation->mTicksPerSecond;
-		aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
-		globalTransformation = globalTransformation.Inverse();
-		ReadHierarchyData(m_RootNode, scene->mRootNode);
-		ReadMissingBones(animation, *model);
+		Load(animation, scene->mRootNode, model->GetBoneInfoMap(), model->GetBoneCount());
 	}
 
-	~Animation()
+	// builds the animation from already imported data, bones the model doesn't know are added to boneInfoMap
+	Animation(const aiAnimation* animation, const aiNode* rootNode, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount)
 	{
+		Load(animation, rootNode, boneInfoMap, boneCount);
 	}
 
-	Bone* FindBone(const std::string& name);
-
+	~Animation()
+	{
+	}
 
-	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
-	inline float GetDuration() { return m_Duration; }
-	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
-	inline const std::map<std::string, BoneInfo>& GetBoneIDMap() { return m_BoneInfoMap; }
+	const Bone* FindBone(const std::string& name) const;
+
+	// gives every node the clip animates a bone id in the model's map. The skeleton keeps every node of the map,
+	// so clips of one rig that blend together need all their channels registered before the first one is built
+	static void RegisterChannels(const aiAnimation* animation, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount);
+
+	// compresses the keys of every bone and drops the resampled clip, animators then decode the packed keys
+	// every frame. The report covers exactly that: memory and error of the keys that play
+	ClipCompressionReport Compress(const ClipCompressionSettings& settings);
+	bool IsCompressed() const { return m_Compressed; }
+
+
+	// everything below is read only once the clip is loaded, so any number of animators can play one Animation.
+	// Their playback state (time, key cursors, poses, bone matrices) lives in the Animator
+	inline float GetTicksPerSecond() const { return m_TicksPerSecond; }
+	inline float GetDuration() const { return m_Duration; }
+	inline const AssimpNodeData& GetRootNode() const { return m_RootNode; }
+	inline const std::map<std::string, BoneInfo>& GetBoneIDMap() const { return m_BoneInfoMap; }
+	inline const std::vector<Bone>& GetBones() const { return m_Bones; }
+	inline const std::vector<SkeletonNode>& GetSkeleton() const { return m_Skeleton; }
+	// constant transforms of the static chains pruned from the skeleton, a node with folded >= 0 is
+	// parent * folded * local
+	inline const std::vector<Affine>& GetFoldedTransforms() const { return m_FoldedTransforms; }
+	// nodes in the file, the skeleton keeps the ones that matter for the bone matrices
+	inline int GetHierarchyNodeCount() const { return m_HierarchyNodeCount; }
+	// same evaluated nodes in the same order, what crossfades and layers need
+	bool SharesSkeleton(const Animation& other) const { return m_NodeNames == other.m_NodeNames; }
+	inline const SampledClip& GetSampledClip() const { return m_SampledClip; }
+	// bytes of keys, hierarchy and resampled frames, what every extra animator doesn't cost
+	size_t GetMemory() const;
+	// bones are sorted by depth, the first GetChannelCount(d) of them belong to nodes at most d deep. -1 for all
+	// bones that have a node in the skeleton
+	int GetChannelCount(int maxDepth) const;
+
+	// local transforms of every skeleton node at animationTime (in ticks), nodes the clip doesn't animate keep
+	// their rest transform. pose must have one entry per skeleton node, cursors one per bone
+	void SamplePose(float animationTime, Pose& pose, BoneCursor* cursors) const;
+	// index of the named node in the skeleton, -1 if there is none
+	int FindNode(const std::string& name) const;
+	// weight for the named node and everything below it, 0 for the rest of the skeleton
+	BoneMask MakeMask(const std::string& rootName, float weight = 1.0f) const;
 
 private:
-	void ReadMissingBones(const aiAnimation* animation, Model& model);
+	void Load(const aiAnimation* animation, const aiNode* rootNode, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount);
+
+	void ReadMissingBones(const aiAnimation* animation, std::map<std::string, BoneInfo>& boneInfoMap, int& boneCount);
 
 	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src);
 
+	// MakeMask for a node the skeleton doesn't keep
+	const AssimpNodeData* FindHierarchyNode(const AssimpNodeData& node, const std::string& name) const;
+	void MarkSubtree(const AssimpNodeData& node, float weight, BoneMask& mask) const;
+
+	void FlattenHierarchy(const AssimpNodeData& node, int parent, int depth);
+
+	// drops the nodes no bone matrix depends on and folds static chains into constant transforms
+	void PruneSkeleton();
+
+	void SortChannelsByDepth();
+
+	void BuildSampledClip();
+
 	float m_Duration;
 	int m_TicksPerSecond;
 	std::vector<Bone> m_Bones;
 	AssimpNodeData m_RootNode;
 	std::map<std::string, BoneInfo> m_BoneInfoMap;
+	std::vector<SkeletonNode> m_Skeleton;
+	std::vector<Affine> m_FoldedTransforms;
+	int m_HierarchyNodeCount = 0;
+	std::vector<int> m_ChannelsUpToDepth;
+	// for pose sampling: node names, the node of every channel and the node transforms as TRS
+	std::vector<std::string> m_NodeNames;
+	std::vector<int> m_ChannelNodes;
+	Pose m_RestPose;
+	SampledClip m_SampledClip;
+	bool m_Compressed = false;
 };
 
 
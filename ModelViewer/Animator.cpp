@@ -1,31 +1,313 @@
 #include "Animator.h"
 
-Animator::Animator(Animation* animation)
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+// animators start their generations far apart, so a new animator at the address of a deleted one never looks unchanged
+static std::atomic<uint64_t> nextGenerationBase{ 1 };
+
+Animator::Animator(const Animation* animation)
 {
+	m_PoseGeneration = nextGenerationBase++ << 32;
 	m_CurrentTime = 0.0;
 	m_CurrentAnimation = animation;
 
-	m_FinalBoneMatrices.reserve(100);
+	// one matrix per bone of the model, the animation added the bones only it knows about
+	m_FinalBoneMatrices.assign(animation->GetBoneIDMap().size(), Affine());
+	m_GlobalTransforms.resize(animation->GetSkeleton().size());
+	m_LocalTransforms.resize(animation->GetBones().size());
+	m_BoneCursors.resize(animation->GetBones().size());
+	ResizePoses(animation);
+}
+
+AnimationLod ChooseAnimationLod(float screenSize, bool visible, const AnimationLodSettings& settings)
+{
+	AnimationLod lod;
+	if (!settings.enabled) return lod;
 
-	for (int i = 0; i < 100; i++)
-		m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
+	if (!visible)
+	{
+		lod.interval = settings.intervals[1];
+		lod.clockOnly = settings.offscreen == 1;
+		lod.paused = settings.offscreen == 2;
+		return lod;
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (screenSize < settings.reducedRateSizes[i]) lod.interval = glm::max(settings.intervals[i], 1);
+	}
+	if (screenSize < settings.reducedBonesSize) lod.maxDepth = settings.reducedDepth;
+	return lod;
 }
 
-void Animator::UpdateAnimation(float dt)
+bool Animator::UpdateAnimation(float dt, const AnimationLod& lod, PoseCache* cache)
 {
 	m_DeltaTime = dt;
-	if (m_CurrentAnimation)
+	// nothing moves, the last pose still holds
+	if (!m_CurrentAnimation || lod.paused || (dt <= 0.0f && m_Posed)) return false;
+
+	m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
+	m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
+	if (m_FadeSource)
 	{
-		m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
-		m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-		CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+		m_FadeSourceTime = fmod(m_FadeSourceTime + m_FadeSource->GetTicksPerSecond() * dt, m_FadeSource->GetDuration());
+		m_FadeElapsed += dt;
+		if (m_FadeElapsed >= m_FadeDuration) m_FadeSource = nullptr;
 	}
+	for (AnimationLayer& layer : m_Layers)
+		layer.time = fmod(layer.time + layer.animation->GetTicksPerSecond() * dt, layer.animation->GetDuration());
+	if (lod.clockOnly) return false;
+
+	// the first pose samples every bone, later ones keep the deep bones of a reduced LOD as they were
+	int limit = m_Posed ? m_CurrentAnimation->GetChannelCount(lod.maxDepth) : -1;
+
+	if (lod.interval <= 1)
+	{
+		PoseSkeleton(limit, cache);
+		m_Interval = 1;
+		m_Posed = true;
+		return true;
+	}
+
+	bool evaluated = false;
+	if (!m_Posed || lod.interval != m_Interval || m_Step >= m_Interval)
+	{
+		// pose where playback will be when the blend ends, the frames until then blend towards it
+		m_PreviousMatrices = m_FinalBoneMatrices;
+		float now = m_CurrentTime;
+		m_LookAhead = dt * (lod.interval - 1);
+		m_CurrentTime = fmod(now + m_CurrentAnimation->GetTicksPerSecond() * m_LookAhead, m_CurrentAnimation->GetDuration());
+		PoseSkeleton(limit, cache);
+		m_CurrentTime = now;
+		m_LookAhead = 0.0f;
+		m_TargetMatrices = m_FinalBoneMatrices;
+		if (!m_Posed) m_PreviousMatrices = m_TargetMatrices;
+
+		m_Interval = lod.interval;
+		m_Step = 0;
+		m_Posed = true;
+		evaluated = true;
+	}
+
+	m_Step++;
+	float blend = static_cast<float>(m_Step) / m_Interval;
+	for (size_t i = 0; i < m_FinalBoneMatrices.size(); ++i)
+		m_FinalBoneMatrices[i] = Mix(m_PreviousMatrices[i], m_TargetMatrices[i], blend);
+	m_PoseGeneration++;
+	return evaluated;
 }
 
-void Animator::PlayAnimation(Animation* pAnimation)
+void Animator::PlayAnimation(const Animation* pAnimation)
 {
 	m_CurrentAnimation = pAnimation;
 	m_CurrentTime = 0.0f;
+	m_FinalBoneMatrices.resize(pAnimation->GetBoneIDMap().size(), Affine());
+	m_GlobalTransforms.resize(pAnimation->GetSkeleton().size());
+	m_LocalTransforms.resize(pAnimation->GetBones().size());
+	m_BoneCursors.assign(pAnimation->GetBones().size(), BoneCursor());
+	m_FadeSource = nullptr;
+	m_Posed = false;
+	// layers of another skeleton would sample and mask poses of the wrong size
+	std::erase_if(m_Layers, [&](const AnimationLayer& layer) { return !layer.animation->SharesSkeleton(*pAnimation); });
+	ResizePoses(pAnimation);
+}
+
+void Animator::CrossFade(const Animation* animation, float seconds)
+{
+	if (!m_CurrentAnimation || seconds <= 0.0f)
+	{
+		PlayAnimation(animation);
+		return;
+	}
+	if (!animation->SharesSkeleton(*m_CurrentAnimation))
+	{
+		std::cout << "ERROR::ANIMATOR::CROSSFADE_SKELETON_MISMATCH: " << animation->GetSkeleton().size() << " nodes, playing "
+			<< m_CurrentAnimation->GetSkeleton().size() << std::endl;
+		PlayAnimation(animation);
+		return;
+	}
+
+	// a fade in progress is cut short, the clip it was heading to becomes the source
+	m_FadeSource = m_CurrentAnimation;
+	m_FadeSourceTime = m_CurrentTime;
+	m_FadeCursors.swap(m_BoneCursors);
+	m_FadeDuration = seconds;
+	m_FadeElapsed = 0.0f;
+
+	m_CurrentAnimation = animation;
+	m_CurrentTime = 0.0f;
+	m_FinalBoneMatrices.resize(animation->GetBoneIDMap().size(), Affine());
+	m_LocalTransforms.resize(animation->GetBones().size());
+	m_BoneCursors.assign(animation->GetBones().size(), BoneCursor());
+	ResizePoses(animation);
+}
+
+int Animator::AddLayer(const Animation* animation, float weight, const BoneMask& mask)
+{
+	// layers blend over the playing clip, there has to be one
+	if (!m_CurrentAnimation || !animation) return -1;
+
+	int nodeCount = static_cast<int>(m_CurrentAnimation->GetSkeleton().size());
+	if (!animation->SharesSkeleton(*m_CurrentAnimation) || (!mask.IsEmpty() && static_cast<int>(mask.weights.size()) != nodeCount))
+	{
+		std::cout << "ERROR::ANIMATOR::LAYER_SKELETON_MISMATCH: " << animation->GetSkeleton().size() << " nodes, playing " << nodeCount << std::endl;
+		return -1;
+	}
+
+	AnimationLayer layer;
+	layer.animation = animation;
+	layer.weight = weight;
+	layer.mask = mask;
+	layer.cursors.resize(animation->GetBones().size());
+	m_Layers.push_back(layer);
+	ResizePoses(animation);
+	return static_cast<int>(m_Layers.size()) - 1;
+}
+
+void Animator::ResizePoses(const Animation* animation)
+{
+	int nodeCount = static_cast<int>(animation->GetSkeleton().size());
+	if (m_Pose.GetSize() == nodeCount) return;
+	m_Pose.Resize(nodeCount);
+	m_BlendPose.Resize(nodeCount);
+}
+
+void Animator::Evaluate(float animationTime)
+{
+	m_CurrentTime = fmod(animationTime, m_CurrentAnimation->GetDuration());
+	CalculateBoneTransforms();
+}
+
+void Animator::PoseSkeleton(int channelLimit, PoseCache* cache)
+{
+	float step = cache ? cache->GetStep() * m_CurrentAnimation->GetTicksPerSecond() : 0.0f;
+	// reduced poses keep the deep bones of each animator's last full pose, they can't be shared
+	bool reduced = channelLimit >= 0 && channelLimit < m_CurrentAnimation->GetChannelCount(-1);
+	if (step <= 0.0f || IsBlending() || reduced)
+	{
+		CalculateBoneTransforms(channelLimit);
+		return;
+	}
+
+	// every animator in the same step evaluates at the same time, so any of them can fill the entry
+	int frame = static_cast<int>(m_CurrentTime / step + 0.5f);
+	bool owner = false;
+	PoseCacheEntry* entry = cache->Lookup(m_CurrentAnimation, frame, owner);
+	if (entry && !owner)
+	{
+		// the bone cursors stay where they were, they are only where the next key search starts
+		m_FinalBoneMatrices.assign(entry->bones.begin(), entry->bones.end());
+		m_LocalTransforms.assign(entry->locals.begin(), entry->locals.end());
+		m_PoseGeneration++;
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	float time = m_CurrentTime;
+	m_CurrentTime = glm::min(frame * step, m_CurrentAnimation->GetDuration());
+	CalculateBoneTransforms();
+	m_CurrentTime = time;
+
+	if (owner)
+	{
+		entry->bones.assign(m_FinalBoneMatrices.begin(), m_FinalBoneMatrices.end());
+		entry->locals.assign(m_LocalTransforms.begin(), m_LocalTransforms.end());
+		cache->Publish(entry, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+}
+
+void Animator::CalculateBoneTransforms(int channelLimit)
+{
+	// blends always pose the whole skeleton
+	m_PoseGeneration++;
+	if (IsBlending())
+	{
+		CalculateBlendedTransforms();
+		return;
+	}
+
+	const std::vector<SkeletonNode>& skeleton = m_CurrentAnimation->GetSkeleton();
+	const std::vector<Affine>& folded = m_CurrentAnimation->GetFoldedTransforms();
+	const std::vector<Bone>& bones = m_CurrentAnimation->GetBones();
+
+	// channels whose node was pruned are never sampled
+	const SampledClip& clip = m_CurrentAnimation->GetSampledClip();
+	bool sampled = m_UseSampledClip && !clip.IsEmpty();
+	if (sampled)
+		clip.Sample(m_CurrentTime, m_LocalTransforms.data(), channelLimit < 0 ? m_CurrentAnimation->GetChannelCount(-1) : channelLimit);
+
+	for (size_t i = 0; i < skeleton.size(); ++i)
+	{
+		const SkeletonNode& node = skeleton[i];
+
+		Affine nodeTransform = node.transformation;
+		if (node.channel >= 0)
+		{
+			if (!sampled && (channelLimit < 0 || node.channel < channelLimit))
+			{
+				m_LocalTransforms[node.channel] = bones[node.channel].GetLocalTransform(m_CurrentTime, m_BoneCursors[node.channel]);
+			}
+			nodeTransform = m_LocalTransforms[node.channel];
+		}
+		if (node.folded >= 0) nodeTransform = folded[node.folded] * nodeTransform;
+
+		// parents were written earlier in this loop
+		m_GlobalTransforms[i] = node.parent >= 0 ? m_GlobalTransforms[node.parent] * nodeTransform : nodeTransform;
+
+		if (node.boneIndex >= 0)
+			m_FinalBoneMatrices[node.boneIndex] = m_GlobalTransforms[i] * node.offset;
+	}
+}
+
+size_t Animator::GetMemory() const
+{
+	size_t poses = (m_Pose.positions.capacity() + m_BlendPose.positions.capacity()) * (2 * sizeof(glm::vec3) + sizeof(glm::quat));
+	size_t bytes = sizeof(Animator) + poses + (m_BoneCursors.capacity() + m_FadeCursors.capacity()) * sizeof(BoneCursor) +
+		(m_FinalBoneMatrices.capacity() + m_GlobalTransforms.capacity() + m_LocalTransforms.capacity() +
+		 m_PreviousMatrices.capacity() + m_TargetMatrices.capacity()) * sizeof(Affine);
+	for (const AnimationLayer& layer : m_Layers)
+		bytes += sizeof(AnimationLayer) + layer.mask.weights.capacity() * sizeof(float) + layer.cursors.capacity() * sizeof(BoneCursor);
+	return bytes;
+}
+
+void Animator::CalculateBlendedTransforms()
+{
+	const std::vector<SkeletonNode>& skeleton = m_CurrentAnimation->GetSkeleton();
+	const std::vector<Affine>& folded = m_CurrentAnimation->GetFoldedTransforms();
+	m_CurrentAnimation->SamplePose(m_CurrentTime, m_Pose, m_BoneCursors.data());
+
+	if (m_FadeSource)
+	{
+		float time = fmod(m_FadeSourceTime + m_FadeSource->GetTicksPerSecond() * m_LookAhead, m_FadeSource->GetDuration());
+		m_FadeSource->SamplePose(time, m_BlendPose, m_FadeCursors.data());
+		float weight = glm::clamp((m_FadeElapsed + m_LookAhead) / m_FadeDuration, 0.0f, 1.0f);
+		BlendPoses(m_BlendPose, m_Pose, weight, nullptr, m_Pose);
+	}
+
+	for (AnimationLayer& layer : m_Layers)
+	{
+		if (layer.weight <= 0.0f) continue;
+		float time = fmod(layer.time + layer.animation->GetTicksPerSecond() * m_LookAhead, layer.animation->GetDuration());
+		layer.animation->SamplePose(time, m_BlendPose, layer.cursors.data());
+		BlendPoses(m_Pose, m_BlendPose, layer.weight, &layer.mask, m_Pose);
+	}
+
+	for (size_t i = 0; i < skeleton.size(); ++i)
+	{
+		const SkeletonNode& node = skeleton[i];
+		Affine nodeTransform = m_Pose.GetTransform(static_cast<int>(i));
+
+		// keeps the locals current for reduced bone LODs once the blend is over
+		if (node.channel >= 0) m_LocalTransforms[node.channel] = nodeTransform;
+		if (node.folded >= 0) nodeTransform = folded[node.folded] * nodeTransform;
+
+		m_GlobalTransforms[i] = node.parent >= 0 ? m_GlobalTransforms[node.parent] * nodeTransform : nodeTransform;
+
+		if (node.boneIndex >= 0)
+			m_FinalBoneMatrices[node.boneIndex] = m_GlobalTransforms[i] * node.offset;
+	}
 }
 
 void Animator::CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
@@ -33,12 +315,12 @@ void Animator::CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 pare
 	std::string nodeName = node->name;
 	glm::mat4 nodeTransform = node->transformation;
 
-	Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
+	const Bone* bone = m_CurrentAnimation->FindBone(nodeName);
 
-	if (Bone)
+	if (bone)
 	{
-		Bone->Update(m_CurrentTime);
-		nodeTransform = Bone->GetLocalTransform();
+		int channel = static_cast<int>(bone - m_CurrentAnimation->GetBones().data());
+		nodeTransform = bone->GetLocalTransform(m_CurrentTime, m_BoneCursors[channel]).ToMat4();
 	}
 
 	glm::mat4 globalTransformation = parentTransform * nodeTransform;
@@ -48,7 +330,7 @@ void Animator::CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 pare
 	{
 		int index = boneInfoMap[nodeName].id;
 		glm::mat4 offset = boneInfoMap[nodeName].offset;
-		m_FinalBoneMatrices[index] = globalTransformation * offset;
+		m_FinalBoneMatrices[index] = Affine(globalTransformation * offset);
 	}
 
 	for (int i = 0; i < node->childrenCount; i++)
@@ -2,30 +2,130 @@
 #define ANIMATOR_CLASS_H
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <map>
+#include <span>
 #include <vector>
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 
 #include "Animation.h"
 #include "Bone.h"
+#include "Pose.h"
+#include "PoseCache.h"
+
+// what an animator evaluates this frame, see ChooseAnimationLod
+struct AnimationLod
+{
+	int interval = 1;		// frames per evaluated pose, the frames in between blend towards the next pose
+	int maxDepth = -1;		// deepest evaluated node, deeper bones keep their last local transform. -1 for all
+	bool clockOnly = false;	// time advances but nothing is posed
+	bool paused = false;	// time stands still
+};
+
+struct AnimationLodSettings
+{
+	bool enabled = true;
+	// projected diameter in pixels below which only every intervals[i]-th frame is evaluated
+	float reducedRateSizes[2] = { 250.0f, 100.0f };
+	int intervals[2] = { 2, 4 };
+	// projected diameter in pixels below which only nodes up to reducedDepth are evaluated
+	float reducedBonesSize = 150.0f;
+	int reducedDepth = 5;
+	// characters outside the frustum: 0 update at the lowest rate, 1 clock only, 2 paused
+	int offscreen = 1;
+};
+
+inline AnimationLodSettings animationLodSettings;
+
+AnimationLod ChooseAnimationLod(float screenSize, bool visible, const AnimationLodSettings& settings = animationLodSettings);
+
+// a clip blended over the base animation, the mask limits it to part of the skeleton
+struct AnimationLayer
+{
+	const Animation* animation = nullptr;
+	float time = 0.0f;		// in ticks of the layer's clip
+	float weight = 1.0f;
+	BoneMask mask;			// empty for the whole skeleton
+	std::vector<BoneCursor> cursors;
+};
 
 class Animator
 {
 public:
-	Animator(Animation* animation);
+	Animator(const Animation* animation);
+
+	// advances playback by dt seconds and poses the skeleton as the LOD allows, returns true if a pose was evaluated.
+	// With a cache, poses are taken at the quantized time and shared with other animators playing the same clip
+	bool UpdateAnimation(float dt, const AnimationLod& lod = AnimationLod(), PoseCache* cache = nullptr);
+
+	// layers that don't share the new clip's skeleton are dropped
+	void PlayAnimation(const Animation* pAnimation);
+
+	// blends from the playing clip to animation over seconds, the old clip keeps playing until the fade is done.
+	// Clips have to come from the same skeleton
+	void CrossFade(const Animation* animation, float seconds);
+
+	// layers are blended over the base clip in the order they were added, all buffers are allocated here so
+	// updating a blended animator doesn't allocate. Returns the index of the layer
+	int AddLayer(const Animation* animation, float weight, const BoneMask& mask = BoneMask());
+	void SetLayerWeight(int layer, float weight) { m_Layers[layer].weight = weight; }
+	void ClearLayers() { m_Layers.clear(); }
+	bool IsBlending() const { return m_FadeSource != nullptr || !m_Layers.empty(); }
 
-	void UpdateAnimation(float dt);
+	// poses the skeleton at animationTime (in ticks) without advancing playback, used for baking
+	void Evaluate(float animationTime);
 
-	void PlayAnimation(Animation* pAnimation);
+	// one pass over the flattened skeleton, no lookups or allocations. Only the first channelLimit bones
+	// (sorted by depth) are sampled, -1 samples all
+	void CalculateBoneTransforms(int channelLimit = -1);
 
+	// recursive evaluation over the node tree, kept as the reference for the skeleton benchmark
 	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform);
 
-	std::vector<glm::mat4> GetFinalBoneMatrices() { return m_FinalBoneMatrices; }
+	const std::vector<Affine>& GetFinalBoneMatrices() { return m_FinalBoneMatrices; }
+	// view of the final bone matrices, valid until the next update
+	std::span<const Affine> GetBoneMatrices() const { return m_FinalBoneMatrices; }
+	// increases every time the final bone matrices change, paused or stopped animators keep it
+	uint64_t GetPoseGeneration() const { return m_PoseGeneration; }
+	// bytes of playback state, the clips themselves are shared and not counted
+	size_t GetMemory() const;
+
+	// sample the resampled SoA clip instead of interpolating every bone's keys, on by default
+	void UseSampledClip(bool enabled) { m_UseSampledClip = enabled; }
 
 private:
-	std::vector<glm::mat4> m_FinalBoneMatrices;
-	Animation* m_CurrentAnimation;
+	std::vector<Affine> m_FinalBoneMatrices;
+	uint64_t m_PoseGeneration = 0;
+	std::vector<Affine> m_GlobalTransforms;
+	std::vector<Affine> m_LocalTransforms;
+	std::vector<BoneCursor> m_BoneCursors;
+	bool m_UseSampledClip = true;
+
+	// CalculateBoneTransforms through the cache, blended animators and reduced bone counts always evaluate their own
+	void PoseSkeleton(int channelLimit, PoseCache* cache);
+
+	// blending works on TRS poses per skeleton node, m_BlendPose holds the clip being blended in
+	void CalculateBlendedTransforms();
+	void ResizePoses(const Animation* animation);
+	Pose m_Pose;
+	Pose m_BlendPose;
+	const Animation* m_FadeSource = nullptr;
+	std::vector<BoneCursor> m_FadeCursors;
+	float m_FadeSourceTime = 0.0f;
+	float m_FadeDuration = 0.0f;
+	float m_FadeElapsed = 0.0f;
+	std::vector<AnimationLayer> m_Layers;
+	// seconds the reduced rate path evaluates ahead of the clocks
+	float m_LookAhead = 0.0f;
+
+	// reduced rate: the output blends from m_PreviousMatrices to m_TargetMatrices over m_Interval frames
+	std::vector<Affine> m_PreviousMatrices;
+	std::vector<Affine> m_TargetMatrices;
+	int m_Interval = 1;
+	int m_Step = 0;
+	bool m_Posed = false;
+	const Animation* m_CurrentAnimation;
 	float m_CurrentTime;
 	float m_DeltaTime;
 
@@ -1,6 +1,8 @@
 #include "Bone.h"
 
-Bone::Bone(const std::string& name, int ID, const aiNodeAnim* channel) : m_Name(name), m_ID(ID), m_LocalTransform(1.0f)
+#include <algorithm>
+
+Bone::Bone(const std::string& name, int ID, const aiNodeAnim* channel) : m_Name(name), m_ID(ID)
 {
 	m_NumPositions = channel->mNumPositionKeys;
 
@@ -35,44 +37,89 @@ Bone::Bone(const std::string& name, int ID, const aiNodeAnim* channel) : m_Name(
 		data.timeStamp = timeStamp;
 		m_Scales.push_back(data);
 	}
-}
 
-void Bone::Update(float animationTime)
-{
-	glm::mat4 translation = InterpolatePosition(animationTime);
-	glm::mat4 rotation = InterpolateRotation(animationTime);
-	glm::mat4 scale = InterpolateScaling(animationTime);
-	m_LocalTransform = translation * rotation * scale;
+	m_PositionTrack = MakeTrack(m_Positions);
+	m_RotationTrack = MakeTrack(m_Rotations);
+	m_ScaleTrack = MakeTrack(m_Scales);
 }
 
-int Bone::GetPositionIndex(float animationTime)
+template<typename Key>
+KeyTrack Bone::MakeTrack(const std::vector<Key>& keys)
 {
-	for (int index = 0; index < m_NumPositions - 1; ++index)
+	KeyTrack track;
+	int count = static_cast<int>(keys.size());
+	if (count < 2) return track;
+
+	track.firstTime = keys[0].timeStamp;
+	float step = (keys[count - 1].timeStamp - keys[0].timeStamp) / (count - 1);
+	if (step <= 0.0f) return track;
+
+	// exported clips are mostly baked at a fixed rate, small deviations are tolerated
+	for (int i = 1; i < count; ++i)
 	{
-		if (animationTime < m_Positions[index + 1].timeStamp)
-			return index;
+		if (glm::abs(keys[i].timeStamp - (track.firstTime + i * step)) > step * 0.01f)
+			return track;
 	}
-	assert(0);
+	track.uniform = true;
+	track.inverseStep = 1.0f / step;
+	return track;
 }
 
-int Bone::GetRotationIndex(float animationTime)
+template<typename Key>
+int Bone::FindKey(const std::vector<Key>& keys, const KeyTrack& track, int& cursor, float animationTime)
 {
-	for (int index = 0; index < m_NumRotations - 1; ++index)
+	int last = static_cast<int>(keys.size()) - 2;
+	if (last <= 0 || animationTime <= keys[0].timeStamp) return 0;
+	if (animationTime >= keys[last].timeStamp) return last;
+
+	if (track.uniform)
 	{
-		if (animationTime < m_Rotations[index + 1].timeStamp)
-			return index;
+		// only off by rounding
+		int index = glm::clamp(static_cast<int>((animationTime - track.firstTime) * track.inverseStep), 0, last);
+		while (index > 0 && animationTime < keys[index].timeStamp) index--;
+		while (index < last && animationTime >= keys[index + 1].timeStamp) index++;
+		return index;
 	}
-	assert(0);
-}
 
-int Bone::GetScaleIndex(float animationTime)
-{
-	for (int index = 0; index < m_NumScalings - 1; ++index)
+	// playback moves forward by at most a key or two per frame, seeking and looping search
+	int index = glm::min(cursor, last);
+	if (animationTime >= keys[index].timeStamp && animationTime < keys[index + 1].timeStamp)
+		return index;
+	if (animationTime >= keys[index + 1].timeStamp && index + 1 < last && animationTime < keys[index + 2].timeStamp)
+		index = index + 1;
+	else
 	{
-		if (animationTime < m_Scales[index + 1].timeStamp)
-			return index;
+		auto next = std::upper_bound(keys.begin() + 1, keys.begin() + last + 1, animationTime,
+			[](float time, const Key& key) { return time < key.timeStamp; });
+		index = static_cast<int>(next - keys.begin()) - 1;
 	}
-	assert(0);
+
+	cursor = index;
+	return index;
+}
+
+Affine Bone::GetLocalTransform(float animationTime, BoneCursor& cursor) const
+{
+	return Affine::FromTRS(SamplePosition(animationTime, cursor.position), SampleRotation(animationTime, cursor.rotation),
+		SampleScale(animationTime, cursor.scale));
+}
+
+int Bone::GetPositionIndex(float animationTime, int& cursor) const
+{
+	if (m_Compressed) return FindKey(m_PackedPositions, m_PositionTrack, cursor, animationTime);
+	return FindKey(m_Positions, m_PositionTrack, cursor, animationTime);
+}
+
+int Bone::GetRotationIndex(float animationTime, int& cursor) const
+{
+	if (m_Compressed) return FindKey(m_PackedRotations, m_RotationTrack, cursor, animationTime);
+	return FindKey(m_Rotations, m_RotationTrack, cursor, animationTime);
+}
+
+int Bone::GetScaleIndex(float animationTime, int& cursor) const
+{
+	if (m_Compressed) return FindKey(m_PackedScales, m_ScaleTrack, cursor, animationTime);
+	return FindKey(m_Scales, m_ScaleTrack, cursor, animationTime);
 }
 
 float Bone::GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
@@ -80,53 +127,168 @@ float Bone::GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float anima
 	float scaleFactor = 0.0f;
 	float midWayLength = animationTime - lastTimeStamp;
 	float framesDiff = nextTimeStamp - lastTimeStamp;
-	scaleFactor = midWayLength / framesDiff;
+	if (framesDiff <= 0.0f) return 0.0f;
+	// times outside the track hold the first or last key
+	scaleFactor = glm::clamp(midWayLength / framesDiff, 0.0f, 1.0f);
 	return scaleFactor;
 }
 
-glm::mat4 Bone::InterpolatePosition(float animationTime)
+glm::vec3 Bone::SamplePosition(float animationTime, int& cursor) const
 {
+	if (m_Compressed)
+	{
+		if (1 == m_NumPositions)
+			return UnpackVector(m_PackedPositions[0], m_PositionRange);
+
+		int p0Index = GetPositionIndex(animationTime, cursor);
+		float scaleFactor = GetScaleFactor(m_PackedPositions[p0Index].timeStamp,
+			m_PackedPositions[p0Index + 1].timeStamp, animationTime);
+		return glm::mix(UnpackVector(m_PackedPositions[p0Index], m_PositionRange),
+			UnpackVector(m_PackedPositions[p0Index + 1], m_PositionRange), scaleFactor);
+	}
+
 	if (1 == m_NumPositions)
-		return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
+		return m_Positions[0].position;
 
-	int p0Index = GetPositionIndex(animationTime);
+	int p0Index = GetPositionIndex(animationTime, cursor);
 	int p1Index = p0Index + 1;
 	float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
 		m_Positions[p1Index].timeStamp, animationTime);
-	glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
-		, scaleFactor);
-	return glm::translate(glm::mat4(1.0f), finalPosition);
+	return glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position, scaleFactor);
 }
 
-glm::mat4 Bone::InterpolateRotation(float animationTime)
+glm::quat Bone::SampleRotation(float animationTime, int& cursor) const
 {
-	if (1 == m_NumRotations)
+	if (m_Compressed)
 	{
-		auto rotation = glm::normalize(m_Rotations[0].orientation);
-		return glm::toMat4(rotation);
+		if (1 == m_NumRotations)
+			return UnpackQuaternion(m_PackedRotations[0]);
+
+		int p0Index = GetRotationIndex(animationTime, cursor);
+		float scaleFactor = GetScaleFactor(m_PackedRotations[p0Index].timeStamp,
+			m_PackedRotations[p0Index + 1].timeStamp, animationTime);
+		return glm::normalize(glm::slerp(UnpackQuaternion(m_PackedRotations[p0Index]),
+			UnpackQuaternion(m_PackedRotations[p0Index + 1]), scaleFactor));
 	}
 
-	int p0Index = GetRotationIndex(animationTime);
+	if (1 == m_NumRotations)
+		return glm::normalize(m_Rotations[0].orientation);
+
+	int p0Index = GetRotationIndex(animationTime, cursor);
 	int p1Index = p0Index + 1;
 	float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
 		m_Rotations[p1Index].timeStamp, animationTime);
 	glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
 		, scaleFactor);
-	finalRotation = glm::normalize(finalRotation);
-	return glm::toMat4(finalRotation);
-
+	return glm::normalize(finalRotation);
 }
 
-glm::mat4 Bone::InterpolateScaling(float animationTime)
+glm::vec3 Bone::SampleScale(float animationTime, int& cursor) const
 {
+	if (m_Compressed)
+	{
+		if (1 == m_NumScalings)
+			return UnpackVector(m_PackedScales[0], m_ScaleRange);
+
+		int p0Index = GetScaleIndex(animationTime, cursor);
+		float scaleFactor = GetScaleFactor(m_PackedScales[p0Index].timeStamp,
+			m_PackedScales[p0Index + 1].timeStamp, animationTime);
+		return glm::mix(UnpackVector(m_PackedScales[p0Index], m_ScaleRange),
+			UnpackVector(m_PackedScales[p0Index + 1], m_ScaleRange), scaleFactor);
+	}
+
 	if (1 == m_NumScalings)
-		return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
+		return m_Scales[0].scale;
 
-	int p0Index = GetScaleIndex(animationTime);
+	int p0Index = GetScaleIndex(animationTime, cursor);
 	int p1Index = p0Index + 1;
 	float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
 		m_Scales[p1Index].timeStamp, animationTime);
-	glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
-		, scaleFactor);
-	return glm::scale(glm::mat4(1.0f), finalScale);
+	return glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale, scaleFactor);
+}
+
+float Bone::GetFirstTime() const
+{
+	if (m_Compressed)
+		return std::min(m_PackedPositions[0].timeStamp, std::min(m_PackedRotations[0].timeStamp, m_PackedScales[0].timeStamp));
+	return std::min(m_Positions[0].timeStamp, std::min(m_Rotations[0].timeStamp, m_Scales[0].timeStamp));
+}
+
+float Bone::GetLastTime() const
+{
+	if (m_Compressed)
+		return std::max(m_PackedPositions.back().timeStamp, std::max(m_PackedRotations.back().timeStamp, m_PackedScales.back().timeStamp));
+	return std::max(m_Positions.back().timeStamp, std::max(m_Rotations.back().timeStamp, m_Scales.back().timeStamp));
+}
+
+size_t Bone::GetMemory() const
+{
+	return m_Positions.size() * sizeof(KeyPosition) + m_Rotations.size() * sizeof(KeyRotation) + m_Scales.size() * sizeof(KeyScale) +
+		(m_PackedPositions.size() + m_PackedRotations.size() + m_PackedScales.size()) * sizeof(PackedKey) + sizeof(Bone);
+}
+
+void Bone::Compress(const ClipCompressionSettings& settings, ClipCompressionReport& report)
+{
+	if (m_Compressed) return;
+
+	auto vectorLerp = [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+	auto vectorError = [](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); };
+	auto rotationLerp = [](const glm::quat& a, const glm::quat& b, float t) { return glm::slerp(a, b, t); };
+	auto rotationError = [](const glm::quat& a, const glm::quat& b)
+	{
+		// angle of the difference rotation, atan2 stays precise for the tiny angles acos(dot) loses
+		glm::quat difference = glm::conjugate(glm::normalize(b)) * glm::normalize(a);
+		return glm::degrees(2.0f * glm::atan(glm::length(glm::vec3(difference.x, difference.y, difference.z)), glm::abs(difference.w)));
+	};
+
+	std::vector<float> positionTimes, rotationTimes, scaleTimes;
+	std::vector<glm::vec3> positions, scales;
+	std::vector<glm::quat> rotations;
+	for (const KeyPosition& key : m_Positions) { positionTimes.push_back(key.timeStamp); positions.push_back(key.position); }
+	for (const KeyRotation& key : m_Rotations) { rotationTimes.push_back(key.timeStamp); rotations.push_back(key.orientation); }
+	for (const KeyScale& key : m_Scales) { scaleTimes.push_back(key.timeStamp); scales.push_back(key.scale); }
+
+	std::vector<int> keptPositions = ReduceKeys(positionTimes, positions, settings.positionTolerance, vectorLerp, vectorError);
+	std::vector<int> keptRotations = ReduceKeys(rotationTimes, rotations, settings.rotationTolerance, rotationLerp, rotationError);
+	std::vector<int> keptScales = ReduceKeys(scaleTimes, scales, settings.scaleTolerance, vectorLerp, vectorError);
+
+	// ranges only cover the kept keys so constant tracks lose nothing to quantization
+	std::vector<glm::vec3> values;
+	for (int i : keptPositions) values.push_back(positions[i]);
+	m_PositionRange = QuantizedRange::Of(values);
+	values.clear();
+	for (int i : keptScales) values.push_back(scales[i]);
+	m_ScaleRange = QuantizedRange::Of(values);
+
+	for (int i : keptPositions) m_PackedPositions.push_back(PackVector(positions[i], m_PositionRange, positionTimes[i]));
+	for (int i : keptRotations) m_PackedRotations.push_back(PackQuaternion(rotations[i], rotationTimes[i]));
+	for (int i : keptScales) m_PackedScales.push_back(PackVector(scales[i], m_ScaleRange, scaleTimes[i]));
+
+	report.tracks += 3;
+	report.constantTracks += (keptPositions.size() == 1) + (keptRotations.size() == 1) + (keptScales.size() == 1);
+	report.keysBefore += m_NumPositions + m_NumRotations + m_NumScalings;
+	report.bytesBefore += m_Positions.size() * sizeof(KeyPosition) + m_Rotations.size() * sizeof(KeyRotation) + m_Scales.size() * sizeof(KeyScale);
+
+	std::vector<KeyPosition>().swap(m_Positions);
+	std::vector<KeyRotation>().swap(m_Rotations);
+	std::vector<KeyScale>().swap(m_Scales);
+	m_Compressed = true;
+	m_NumPositions = static_cast<int>(m_PackedPositions.size());
+	m_NumRotations = static_cast<int>(m_PackedRotations.size());
+	m_NumScalings = static_cast<int>(m_PackedScales.size());
+	m_PositionTrack = MakeTrack(m_PackedPositions);
+	m_RotationTrack = MakeTrack(m_PackedRotations);
+	m_ScaleTrack = MakeTrack(m_PackedScales);
+
+	report.keysAfter += m_NumPositions + m_NumRotations + m_NumScalings;
+	report.bytesAfter += (m_NumPositions + m_NumRotations + m_NumScalings) * sizeof(PackedKey) + 2 * sizeof(QuantizedRange);
+
+	// measured through the same decoding the animator uses
+	BoneCursor cursor;
+	for (unsigned int i = 0; i < positions.size(); ++i)
+		report.maxPositionError = glm::max(report.maxPositionError, vectorError(SamplePosition(positionTimes[i], cursor.position), positions[i]));
+	for (unsigned int i = 0; i < rotations.size(); ++i)
+		report.maxRotationError = glm::max(report.maxRotationError, rotationError(SampleRotation(rotationTimes[i], cursor.rotation), rotations[i]));
+	for (unsigned int i = 0; i < scales.size(); ++i)
+		report.maxScaleError = glm::max(report.maxScaleError, vectorError(SampleScale(scaleTimes[i], cursor.scale), scales[i]));
 }
@@ -6,12 +6,15 @@
 #include <vector>
 #include <assimp/scene.h>
 #include <list>
+#include <algorithm>
 #include <glm/glm.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 
 #include "AssimpGlmHelpers.h"
+#include "ClipCompression.h"
+#include "Affine.h"
 
 struct KeyPosition
 {
@@ -31,35 +34,70 @@ struct KeyScale
 	float timeStamp;
 };
 
+// how keys of one track are found. Evenly sampled tracks compute the index directly,
+// the others continue from the key found last time and only search when playback jumps
+struct KeyTrack
+{
+	bool uniform = false;
+	float firstTime = 0.0f;
+	float inverseStep = 0.0f;
+};
+
+// the keys found last time for each track of a bone. Playback state, every animator keeps its own so any
+// number of them can play the same clip
+struct BoneCursor
+{
+	int position = 0;
+	int rotation = 0;
+	int scale = 0;
+};
+
 class Bone
 {
 public:
 	Bone(const std::string& name, int ID, const aiNodeAnim* channel);
 
-	void Update(float animationTime);
-
-	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
+	// local transform at animationTime, cursor is the caller's playback state for this bone. The bone itself
+	// is never written while playing
+	Affine GetLocalTransform(float animationTime, BoneCursor& cursor) const;
 	std::string GetBoneName() const { return m_Name; }
-	int GetBoneID() { return m_ID; }
+	int GetBoneID() const { return m_ID; }
 
+	// interpolated track values, used to resample the clip
+	glm::vec3 SamplePosition(float animationTime, int& cursor) const;
+	glm::quat SampleRotation(float animationTime, int& cursor) const;
+	glm::vec3 SampleScale(float animationTime, int& cursor) const;
+	glm::vec3 SamplePosition(float animationTime) const { int cursor = 0; return SamplePosition(animationTime, cursor); }
+	glm::quat SampleRotation(float animationTime) const { int cursor = 0; return SampleRotation(animationTime, cursor); }
+	glm::vec3 SampleScale(float animationTime) const { int cursor = 0; return SampleScale(animationTime, cursor); }
 
+	float GetFirstTime() const;
+	float GetLastTime() const;
+	int GetMaxKeyCount() const { return std::max(m_NumPositions, std::max(m_NumRotations, m_NumScalings)); }
+	size_t GetMemory() const;
 
-	int GetPositionIndex(float animationTime);
+	// drops keys that interpolation reproduces within the tolerances and quantizes the rest,
+	// the original keys are freed and sampling decodes the packed keys from then on
+	void Compress(const ClipCompressionSettings& settings, ClipCompressionReport& report);
+	bool IsCompressed() const { return m_Compressed; }
 
-	int GetRotationIndex(float animationTime);
+	// index of the key before animationTime, clamped to the first and last pair of keys
+	int GetPositionIndex(float animationTime, int& cursor) const;
 
-	int GetScaleIndex(float animationTime);
+	int GetRotationIndex(float animationTime, int& cursor) const;
 
+	int GetScaleIndex(float animationTime, int& cursor) const;
 
-private:
 
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime);
+private:
 
-	glm::mat4 InterpolatePosition(float animationTime);
+	template<typename Key>
+	static KeyTrack MakeTrack(const std::vector<Key>& keys);
 
-	glm::mat4 InterpolateRotation(float animationTime);
+	template<typename Key>
+	static int FindKey(const std::vector<Key>& keys, const KeyTrack& track, int& cursor, float animationTime);
 
-	glm::mat4 InterpolateScaling(float animationTime);
+	static float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime);
 
 	std::vector<KeyPosition> m_Positions;
 	std::vector<KeyRotation> m_Rotations;
@@ -67,8 +105,17 @@ private:
 	int m_NumPositions;
 	int m_NumRotations;
 	int m_NumScalings;
+	KeyTrack m_PositionTrack;
+	KeyTrack m_RotationTrack;
+	KeyTrack m_ScaleTrack;
+
+	bool m_Compressed = false;
+	std::vector<PackedKey> m_PackedPositions;
+	std::vector<PackedKey> m_PackedRotations;
+	std::vector<PackedKey> m_PackedScales;
+	QuantizedRange m_PositionRange;
+	QuantizedRange m_ScaleRange;
 
-	glm::mat4 m_LocalTransform;
 	std::string m_Name;
 	int m_ID;
 };
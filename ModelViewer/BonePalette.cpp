@@ -0,0 +1,94 @@
+#include "BonePalette.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+void BonePalette::Begin()
+{
+    slotCount = 0;
+    matrixCount = 0;
+}
+
+int BonePalette::Add(const void* source, std::span<const Affine> bones, uint64_t generation)
+{
+    int count = static_cast<int>(bones.size());
+    if (matrixCount + count > GetMaxMatrices())
+    {
+        if (!overflowReported)
+            std::cout << "ERROR::BONE_PALETTE::TOO_MANY_BONES: " << matrixCount + count << " matrices, the limit is " << GetMaxMatrices() << std::endl;
+        overflowReported = true;
+        return -1;
+    }
+
+    int offset = matrixCount;
+    matrixCount += count;
+
+    if (slotCount < static_cast<int>(slots.size()))
+        slots[slotCount] = { source, generation, offset, bones };
+    else
+        slots.push_back({ source, generation, offset, bones });
+    slotCount++;
+    return offset;
+}
+
+int BonePalette::GetMaxMatrices()
+{
+    if (maxMatrices == 0)
+    {
+        // one texel is one row, a matrix takes 3
+        GLint texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+        maxMatrices = std::max(texels, 65536) / 3;
+    }
+    return maxMatrices;
+}
+
+void BonePalette::Upload()
+{
+    PROFILE_FUNCTION();
+
+    // the oldest buffer, the GPU is done with it by now
+    current = (current + 1) % BUFFER_COUNT;
+    Buffer& target = buffers[current];
+    if (!target.buffer)
+    {
+        glGenBuffers(1, &target.buffer);
+        glGenTextures(1, &target.texture);
+    }
+
+    size_t size = matrixCount * sizeof(Affine);
+    bool reallocated = false;
+    glBindBuffer(GL_TEXTURE_BUFFER, target.buffer);
+    if (size > target.capacity)
+    {
+        size_t maxSize = GetMaxMatrices() * sizeof(Affine);
+        target.capacity = std::min(size * 2, maxSize);
+        glBufferData(GL_TEXTURE_BUFFER, target.capacity, NULL, GL_DYNAMIC_DRAW);
+        target.uploaded.clear();
+        reallocated = true;
+    }
+
+    // unchanged poses skip the GL call, this buffer was last written BUFFER_COUNT frames ago
+    uploadedMatrices = 0;
+    if (target.uploaded.size() < static_cast<size_t>(slotCount))
+        target.uploaded.resize(slotCount, { nullptr, 0, -1, 0 });
+    for (int i = 0; i < slotCount; ++i)
+    {
+        const Slot& slot = slots[i];
+        UploadedSlot& uploaded = target.uploaded[i];
+        if (uploaded.source == slot.source && uploaded.generation == slot.generation && uploaded.offset == slot.offset &&
+            uploaded.count == slot.bones.size())
+            continue;
+        uploaded = { slot.source, slot.generation, slot.offset, slot.bones.size() };
+        if (slot.bones.empty()) continue;
+        glBufferSubData(GL_TEXTURE_BUFFER, slot.offset * sizeof(Affine), slot.bones.size_bytes(), slot.bones.data());
+        uploadedMatrices += static_cast<int>(slot.bones.size());
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, target.texture);
+    if (reallocated) glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, target.buffer);
+    glActiveTexture(GL_TEXTURE0);
+}
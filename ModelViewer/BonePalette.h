@@ -0,0 +1,74 @@
+#ifndef BONE_PALETTE_H
+#define BONE_PALETTE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Affine.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Bone matrices of every animated instance in one texture buffer, read in the shaders with texelFetch as the
+// 3 rows of each affine matrix.
+// Each instance gets an offset into it, so rigs aren't limited by the uniform array size. Instances are uploaded
+// straight from their own storage, and only when their pose changed since that buffer was last written. Frames cycle
+// through BUFFER_COUNT buffers so the upload never writes one the GPU may still read from an earlier frame.
+class BonePalette
+{
+public:
+    // texture unit of the samplerBuffer, above the units used by mesh textures
+    static const int TEXTURE_UNIT = 15;
+    static const int BUFFER_COUNT = 3;
+
+    // starts collecting a new frame
+    void Begin();
+    // places the bones of one instance and returns the offset (in matrices) the shaders need. source identifies
+    // the instance, bones have to stay valid until Upload. Returns -1 when the instance doesn't fit in the texture
+    // buffer any more, it can't be drawn then
+    int Add(const void* source, std::span<const Affine> bones, uint64_t generation);
+    // uploads the instances that changed and binds the buffer to TEXTURE_UNIT
+    void Upload();
+
+    // matrices that fit in GL_MAX_TEXTURE_BUFFER_SIZE
+    int GetMaxMatrices();
+
+    int GetMatrixCount() const { return matrixCount; }
+    int GetUploadedMatrices() const { return uploadedMatrices; }
+    size_t GetCapacity() const { return buffers[current].capacity; }
+
+private:
+    struct Slot {
+        const void* source;
+        uint64_t generation;
+        int offset;
+        std::span<const Affine> bones;
+    };
+
+    // what a slot held when it was last written to one of the buffers
+    struct UploadedSlot {
+        const void* source;
+        uint64_t generation;
+        int offset;
+        size_t count;
+    };
+
+    struct Buffer {
+        unsigned int buffer = 0, texture = 0;
+        size_t capacity = 0;    // bytes allocated for the buffer
+        std::vector<UploadedSlot> uploaded;
+    };
+
+    std::vector<Slot> slots;
+    int slotCount = 0;          // slots used this frame
+    int matrixCount = 0;
+    int maxMatrices = 0;        // queried on first use
+    bool overflowReported = false;
+    int uploadedMatrices = 0;   // last frame
+    Buffer buffers[BUFFER_COUNT];
+    int current = 0;            // buffer of the last upload
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+#include <cfloat>
+
+struct AABB
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void Expand(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Expand(const AABB& box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    bool IsValid() const { return min.x <= max.x; }
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extent() const { return max - min; }
+
+    // box containing this box transformed by an affine matrix
+    AABB Transformed(const glm::mat4& m) const
+    {
+        glm::vec3 center = glm::vec3(m * glm::vec4(Center(), 1.0f));
+        glm::vec3 half = Extent() * 0.5f;
+        glm::vec3 newHalf;
+        for (int i = 0; i < 3; ++i)
+            newHalf[i] = glm::abs(m[0][i]) * half.x + glm::abs(m[1][i]) * half.y + glm::abs(m[2][i]) * half.z;
+
+        AABB box;
+        box.min = center - newHalf;
+        box.max = center + newHalf;
+        return box;
+    }
+};
+
+struct BoundingSphere
+{
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// view frustum planes in world space, normals point inside
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    static Frustum FromMatrix(const glm::mat4& viewProj)
+    {
+        Frustum frustum;
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; ++i)
+            row[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+
+        frustum.planes[0] = row[3] + row[0];    // left
+        frustum.planes[1] = row[3] - row[0];    // right
+        frustum.planes[2] = row[3] + row[1];    // bottom
+        frustum.planes[3] = row[3] - row[1];    // top
+        frustum.planes[4] = row[3] + row[2];    // near
+        frustum.planes[5] = row[3] - row[2];    // far
+
+        for (int i = 0; i < 6; ++i)
+            frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+        return frustum;
+    }
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    bool IntersectsAABB(const AABB& box) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            // the box corner furthest along the plane normal
+            glm::vec3 normal = glm::vec3(planes[i]);
+            glm::vec3 corner = glm::vec3(normal.x >= 0.0f ? box.max.x : box.min.x,
+                                         normal.y >= 0.0f ? box.max.y : box.min.y,
+                                         normal.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(normal, corner) + planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -77,9 +77,10 @@ void Camera::MoveToObject(glm::vec3 objectPosition, glm::vec3 size, glm::vec3 ce
     Position *= scale;
     Position += objectPosition;
 
-    glm::vec3 direction = center - Position;
+    // look at the center where it ends up in the world, yaw is measured from +X like in updateCameraVectors
+    glm::vec3 direction = center * scale + objectPosition - Position;
     Pitch = glm::degrees(std::atan2(direction.y, glm::sqrt(direction.x * direction.x + direction.z * direction.z)));
-    Yaw = glm::degrees(atan2(direction.x, direction.z));
+    Yaw = glm::degrees(atan2(direction.z, direction.x));
 
     updateCameraVectors();
 }
@@ -0,0 +1,72 @@
+#include "ClipCompression.h"
+
+#include <cmath>
+
+void ClipCompressionReport::Add(const ClipCompressionReport& other)
+{
+	keysBefore += other.keysBefore;
+	keysAfter += other.keysAfter;
+	tracks += other.tracks;
+	constantTracks += other.constantTracks;
+	bytesBefore += other.bytesBefore;
+	bytesAfter += other.bytesAfter;
+	maxPositionError = glm::max(maxPositionError, other.maxPositionError);
+	maxRotationError = glm::max(maxRotationError, other.maxRotationError);
+	maxScaleError = glm::max(maxScaleError, other.maxScaleError);
+}
+
+QuantizedRange QuantizedRange::Of(const std::vector<glm::vec3>& values)
+{
+	QuantizedRange range;
+	if (values.empty()) return range;
+
+	glm::vec3 max = values[0];
+	range.min = values[0];
+	for (unsigned int i = 1; i < values.size(); ++i)
+	{
+		range.min = glm::min(range.min, values[i]);
+		max = glm::max(max, values[i]);
+	}
+	range.step = (max - range.min) / 65535.0f;
+	return range;
+}
+
+PackedKey PackVector(const glm::vec3& value, const QuantizedRange& range, float timeStamp)
+{
+	PackedKey key;
+	key.timeStamp = timeStamp;
+	for (int i = 0; i < 3; ++i)
+	{
+		float quantized = range.step[i] > 0.0f ? std::round((value[i] - range.min[i]) / range.step[i]) : 0.0f;
+		key.value[i] = static_cast<uint16_t>(glm::clamp(quantized, 0.0f, 65535.0f));
+	}
+	return key;
+}
+
+PackedKey PackQuaternion(const glm::quat& value, float timeStamp)
+{
+	glm::quat q = glm::normalize(value);
+	float c[4] = { q.x, q.y, q.z, q.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+	{
+		if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+	}
+
+	// q and -q are the same rotation, flipping keeps the dropped component positive
+	float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+	PackedKey key;
+	key.timeStamp = timeStamp;
+	int k = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		float normalized = (c[i] * sign + 0.70710678f) / 1.41421356f;
+		key.value[k++] = static_cast<uint16_t>(glm::clamp(std::round(normalized * 32767.0f), 0.0f, 32767.0f));
+	}
+	key.value[0] |= (largest & 1) << 15;
+	key.value[1] |= (largest >> 1) << 15;
+	return key;
+}
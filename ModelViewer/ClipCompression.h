@@ -0,0 +1,115 @@
+#ifndef CLIP_COMPRESSION_H
+#define CLIP_COMPRESSION_H
+
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// error allowed when dropping keys, positions and scales in model units, rotations in degrees
+struct ClipCompressionSettings
+{
+	float positionTolerance = 0.001f;
+	float rotationTolerance = 0.05f;
+	float scaleTolerance = 0.001f;
+};
+
+// what compression did to one or more clips. Bytes are what the animator plays from, before the keys and the
+// resampled clip, after the packed keys. Errors are measured at the original key times through the decoding used
+// at runtime
+struct ClipCompressionReport
+{
+	int keysBefore = 0;
+	int keysAfter = 0;
+	int tracks = 0;
+	int constantTracks = 0;
+	size_t bytesBefore = 0;
+	size_t bytesAfter = 0;
+	float maxPositionError = 0.0f;
+	float maxRotationError = 0.0f;  // degrees
+	float maxScaleError = 0.0f;
+
+	void Add(const ClipCompressionReport& other);
+};
+
+// a key of a compressed track, 16 bit per component: translations and scales are quantized in the range of their
+// track, rotations are stored as the smallest three components with the index of the dropped one in the top bits
+struct PackedKey
+{
+	uint16_t value[3];
+	float timeStamp;
+};
+
+struct QuantizedRange
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 step = glm::vec3(0.0f);
+
+	static QuantizedRange Of(const std::vector<glm::vec3>& values);
+};
+
+PackedKey PackVector(const glm::vec3& value, const QuantizedRange& range, float timeStamp);
+PackedKey PackQuaternion(const glm::quat& value, float timeStamp);
+
+inline glm::vec3 UnpackVector(const PackedKey& key, const QuantizedRange& range)
+{
+	return range.min + range.step * glm::vec3(key.value[0], key.value[1], key.value[2]);
+}
+
+inline glm::quat UnpackQuaternion(const PackedKey& key)
+{
+	const float scale = 1.41421356f / 32767.0f;
+	int largest = (key.value[0] >> 15) | ((key.value[1] >> 15) << 1);
+	float small[3];
+	for (int i = 0; i < 3; ++i) small[i] = (key.value[i] & 0x7fff) * scale - 0.70710678f;
+
+	float c[4];
+	int k = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i != largest) c[i] = small[k++];
+	}
+	c[largest] = glm::sqrt(glm::max(0.0f, 1.0f - small[0] * small[0] - small[1] * small[1] - small[2] * small[2]));
+	return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+// indices of the keys to keep so linear interpolation between them stays within tolerance of every dropped key.
+// Tracks that never leave the tolerance of their first key collapse to that key
+template<typename Value, typename Interpolate, typename Error>
+std::vector<int> ReduceKeys(const std::vector<float>& times, const std::vector<Value>& values, float tolerance, Interpolate interpolate, Error error)
+{
+	int count = static_cast<int>(values.size());
+	std::vector<int> kept;
+	if (count == 0) return kept;
+	kept.push_back(0);
+
+	bool constant = true;
+	for (int i = 1; i < count && constant; ++i) constant = error(values[i], values[0]) <= tolerance;
+	if (constant) return kept;
+
+	// greedy: extend the segment from the last kept key as long as the keys it skips are reproduced,
+	// segments are capped so long linear runs don't make loading quadratic
+	const int maxSegment = 256;
+	int anchor = 0;
+	for (int i = 1; i < count - 1; ++i)
+	{
+		bool skippable = i + 1 - anchor <= maxSegment;
+		float span = times[i + 1] - times[anchor];
+		for (int j = anchor + 1; j <= i && skippable; ++j)
+		{
+			float factor = span > 0.0f ? (times[j] - times[anchor]) / span : 0.0f;
+			skippable = error(interpolate(values[anchor], values[i + 1], factor), values[j]) <= tolerance;
+		}
+		if (!skippable)
+		{
+			kept.push_back(i);
+			anchor = i;
+		}
+	}
+	kept.push_back(count - 1);
+	return kept;
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include "CrowdRenderer.h"
+#include "Model.h"
+#include "Animation.h"
+#include "Animator.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+void CrowdRenderer::Bake(Model& crowdModel, const std::vector<Animation*>& animations, float rate)
+{
+    PROFILE_FUNCTION();
+    auto start = std::chrono::steady_clock::now();
+
+    Clear();
+    model = &crowdModel;
+    sampleRate = rate;
+
+    int boneCount = crowdModel.GetBoneCount();
+    for (unsigned int i = 0; i < animations.size(); ++i)
+        boneCount = glm::max(boneCount, static_cast<int>(animations[i]->GetBoneIDMap().size()));
+
+    // rows of the affine bone matrices, the last row is always 0 0 0 1
+    std::vector<glm::vec4> texels;
+    for (unsigned int i = 0; i < animations.size() && static_cast<int>(i) < MAX_CLIPS; ++i)
+    {
+        Animation* animation = animations[i];
+        float ticksPerSecond = animation->GetTicksPerSecond() > 0.0f ? animation->GetTicksPerSecond() : 25.0f;
+        float seconds = animation->GetDuration() / ticksPerSecond;
+
+        // the last frame blends back into the first, so the clip end itself isn't stored
+        Clip clip;
+        clip.firstRow = static_cast<int>(texels.size()) / (boneCount * 3);
+        clip.frameCount = glm::max(1, static_cast<int>(seconds * rate + 0.5f));
+
+        Animator animator(animation);
+        for (int frame = 0; frame < clip.frameCount; ++frame)
+        {
+            animator.Evaluate(frame / rate * ticksPerSecond);
+            const std::vector<Affine>& bones = animator.GetFinalBoneMatrices();
+            for (int b = 0; b < boneCount; ++b)
+            {
+                Affine bone = b < static_cast<int>(bones.size()) ? bones[b] : Affine();
+                texels.insert(texels.end(), bone.rows, bone.rows + 3);
+            }
+        }
+        clips.push_back(clip);
+    }
+    if (animations.size() > MAX_CLIPS)
+        std::cout << "ERROR::CROWD::TOO_MANY_CLIPS: " << animations.size() << " clips, the limit is " << MAX_CLIPS << std::endl;
+
+    int width = boneCount * 3;
+    int height = width > 0 ? static_cast<int>(texels.size()) / width : 0;
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (width == 0 || height == 0 || width > maxSize || height > maxSize)
+    {
+        std::cout << "ERROR::CROWD::ANIMATION_TEXTURE_SIZE: " << width << "x" << height << ", the limit is " << maxSize << std::endl;
+        Clear();
+        return;
+    }
+
+    glGenTextures(1, &animationTexture);
+    glBindTexture(GL_TEXTURE_2D, animationTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    textureMemory = texels.size() * sizeof(glm::vec4);
+
+    bakeTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CrowdRenderer::Clear()
+{
+    if (animationTexture) glDeleteTextures(1, &animationTexture);
+    animationTexture = 0;
+    textureMemory = 0;
+    clips.clear();
+    model = nullptr;
+}
+
+int CrowdRenderer::AddInstance(const glm::mat4& matrix, int clip, float timeOffset, float speed)
+{
+    if (GetInstanceCount() >= GetMaxInstances()) return -1;
+    for (int row = 0; row < 3; ++row)
+        instances.push_back(glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]));
+    instances.push_back(glm::vec4(static_cast<float>(clip), timeOffset, speed, 0.0f));
+    instancesDirty = true;
+    return GetInstanceCount() - 1;
+}
+
+void CrowdRenderer::ClearInstances()
+{
+    instances.clear();
+    instancesDirty = true;
+}
+
+int CrowdRenderer::GetMaxInstances()
+{
+    if (maxInstances == 0)
+    {
+        GLint texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+        maxInstances = glm::max(texels, 65536) / 4;
+    }
+    return maxInstances;
+}
+
+void CrowdRenderer::Update(float dt)
+{
+    time += dt;
+    if (time < REBASE_SECONDS) return;
+
+    // every instance continues from where it is, in double so nothing jumps
+    for (size_t i = 3; i < instances.size(); i += 4)
+    {
+        glm::vec4& playback = instances[i];
+        int clip = static_cast<int>(playback.x);
+        double length = clip < static_cast<int>(clips.size()) ? clips[clip].frameCount / static_cast<double>(sampleRate) : 0.0;
+        if (length > 0.0) playback.y = static_cast<float>(std::fmod(playback.y + time * playback.z, length));
+    }
+    instancesDirty = true;
+    time = 0.0;
+}
+
+void CrowdRenderer::Draw(ShaderVariants& shaders, const RenderView& view)
+{
+    PROFILE_FUNCTION();
+
+    int count = GetInstanceCount();
+    if (!model || !animationTexture || count == 0) return;
+
+    if (!instanceBuffer)
+    {
+        glGenBuffers(1, &instanceBuffer);
+        glGenTextures(1, &instanceTexture);
+    }
+    if (instancesDirty)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, instances.size() * sizeof(glm::vec4), instances.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        instancesDirty = false;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + ANIMATION_UNIT);
+    glBindTexture(GL_TEXTURE_2D, animationTexture);
+    glActiveTexture(GL_TEXTURE0 + INSTANCE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+    glActiveTexture(GL_TEXTURE0);
+
+    std::string skinnedDefines = "CROWD SKINNED BONE_INFLUENCES=" + std::to_string(glm::max(model->GetBoneInfluences(), 1));
+    for (unsigned int i = 0; i < model->meshes.size(); ++i)
+    {
+        Mesh& mesh = model->meshes[i];
+        Shader& shader = shaders.Get(mesh.IsSkinned() ? skinnedDefines : "CROWD");
+        shader.use();
+        shader.setMat4("projection", view.projection);
+        shader.setMat4("view", view.view);
+        shader.setInt("crowdAnimation", ANIMATION_UNIT);
+        shader.setInt("crowdInstances", INSTANCE_UNIT);
+        shader.setFloat("crowdTime", static_cast<float>(time));
+        shader.setFloat("crowdSampleRate", sampleRate);
+        for (unsigned int c = 0; c < clips.size(); ++c)
+            shader.setVec2("crowdClips[" + std::to_string(c) + "]", static_cast<float>(clips[c].firstRow), static_cast<float>(clips[c].frameCount));
+
+        mesh.DrawInstanced(shader, count);
+    }
+}
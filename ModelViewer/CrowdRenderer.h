@@ -0,0 +1,73 @@
+#ifndef CROWD_RENDERER_H
+#define CROWD_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "ShaderVariants.h"
+#include "RenderView.h"
+
+class Model;
+class Animation;
+
+// Draws many copies of one animated model without an Animator per copy. Every clip is baked once into a bone
+// matrix texture at a fixed sample rate (one row per frame, 3 texels per bone), the vertex shader picks the
+// frame from the instance's clip, time offset and speed and blends the two nearest rows.
+class CrowdRenderer
+{
+public:
+    // texture units, below the bone palette and above the mesh textures
+    static const int ANIMATION_UNIT = 14;
+    static const int INSTANCE_UNIT = 13;
+    // must match MAX_CROWD_CLIPS in vShader.vx
+    static const int MAX_CLIPS = 16;
+
+    // bakes the clips for the model, instances are kept
+    void Bake(Model& model, const std::vector<Animation*>& clips, float sampleRate = 30.0f);
+    void Clear();
+
+    // returns -1 once the instance buffer is full, see GetMaxInstances
+    int AddInstance(const glm::mat4& matrix, int clip, float timeOffset, float speed = 1.0f);
+    void ClearInstances();
+    // instances that fit into a texture buffer on this driver, GL 3.3 only guarantees 65536 texels
+    int GetMaxInstances();
+
+    // advances the playback clock of all instances by dt seconds, once per frame
+    void Update(float dt);
+    void Draw(ShaderVariants& shaders, const RenderView& view);
+
+    const Model* GetModel() const { return model; }
+    int GetInstanceCount() const { return static_cast<int>(instances.size() / 4); }
+    int GetClipCount() const { return static_cast<int>(clips.size()); }
+    size_t GetTextureMemory() const { return textureMemory; }
+    float GetBakeTime() const { return bakeTime; }
+
+private:
+    struct Clip {
+        int firstRow;
+        int frameCount;
+    };
+
+    Model* model = nullptr;
+    std::vector<Clip> clips;
+    float sampleRate = 30.0f;
+    unsigned int animationTexture = 0;
+    size_t textureMemory = 0;
+    float bakeTime = 0.0f;
+
+    // 4 texels per instance: 3 rows of the model matrix, then clip, time offset and speed
+    std::vector<glm::vec4> instances;
+    unsigned int instanceBuffer = 0, instanceTexture = 0;
+    bool instancesDirty = false;
+    int maxInstances = 0;
+
+    // seconds since the time offsets were last rebased, the shader gets it as a float and loses
+    // precision over long sessions, so it is folded into the offsets every REBASE_SECONDS
+    static constexpr double REBASE_SECONDS = 600.0;
+    double time = 0.0;
+};
+
+#endif
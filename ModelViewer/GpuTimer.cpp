@@ -0,0 +1,216 @@
+#include "GpuTimer.h"
+
+#include "imgui.h"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+void GpuTimer::BeginFrame()
+{
+    // the slot we're about to reuse was filled FRAME_LATENCY frames ago
+    FrameSlot& slot = slots[frameIndex % FRAME_LATENCY];
+    ResolveSlot(slot);
+    slot.pending.clear();
+}
+
+void GpuTimer::EndFrame()
+{
+    if (active) End();
+    frameIndex++;
+}
+
+void GpuTimer::Begin(const std::string& name, const std::string& parent)
+{
+    if (active) End();
+
+    FrameSlot& slot = slots[frameIndex % FRAME_LATENCY];
+    if (slot.pending.size() == slot.pool.size())
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        slot.pool.push_back(query);
+    }
+
+    PendingQuery pending;
+    pending.query = slot.pool[slot.pending.size()];
+    pending.stat = FindStat(name, parent);
+    slot.pending.push_back(pending);
+
+    glBeginQuery(GL_TIME_ELAPSED, pending.query);
+    active = true;
+}
+
+void GpuTimer::End()
+{
+    if (!active) return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    active = false;
+}
+
+int GpuTimer::FindStat(const std::string& name, const std::string& parent)
+{
+    auto it = statIndex.find(name);
+    if (it != statIndex.end()) return it->second;
+
+    // parents are listed before their children
+    if (!parent.empty()) FindStat(parent, "");
+
+    Stat stat;
+    stat.name = name;
+    stat.parent = parent;
+    stats.push_back(stat);
+    statIndex[name] = static_cast<int>(stats.size()) - 1;
+
+    return statIndex[name];
+}
+
+void GpuTimer::RemoveStat(const std::string& name)
+{
+    auto it = statIndex.find(name);
+    if (it == statIndex.end()) return;
+    int removed = it->second;
+
+    // queries still in flight point at stats by index. They stay in the slot, Begin hands out the pool in the
+    // order of the pending list, the removed stat's ones are only not counted
+    for (FrameSlot& slot : slots)
+    {
+        for (PendingQuery& pending : slot.pending)
+        {
+            if (pending.stat == removed) pending.stat = -1;
+            else if (pending.stat > removed) pending.stat--;
+        }
+    }
+
+    stats.erase(stats.begin() + removed);
+    statIndex.clear();
+    for (unsigned int i = 0; i < stats.size(); ++i)
+        statIndex[stats[i].name] = i;
+}
+
+void GpuTimer::AddSample(Stat& stat, float ms)
+{
+    stat.last = ms;
+    stat.history[stat.historyPos] = ms;
+    stat.historyPos = (stat.historyPos + 1) % HISTORY_SIZE;
+    if (stat.historyCount < HISTORY_SIZE) stat.historyCount++;
+
+    float sum = 0.0f, maximum = 0.0f;
+    for (int i = 0; i < stat.historyCount; ++i)
+    {
+        sum += stat.history[i];
+        maximum = std::max(maximum, stat.history[i]);
+    }
+    stat.average = sum / stat.historyCount;
+    stat.maximum = maximum;
+}
+
+void GpuTimer::ResolveSlot(FrameSlot& slot)
+{
+    if (slot.pending.empty()) return;
+
+    // queries finish in order, if the last one isn't ready the GPU is more than FRAME_LATENCY frames behind.
+    // Drop the frame instead of waiting for it.
+    GLint available = 0;
+    glGetQueryObjectiv(slot.pending.back().query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        skippedFrames++;
+        return;
+    }
+
+    std::vector<float> frameTime(stats.size(), 0.0f);
+    std::vector<bool> used(stats.size(), false);
+
+    for (unsigned int i = 0; i < slot.pending.size(); ++i)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(slot.pending[i].query, GL_QUERY_RESULT, &elapsed);
+
+        int stat = slot.pending[i].stat;
+        if (stat < 0) continue;
+        float ms = static_cast<float>(elapsed) / 1000000.0f;
+        frameTime[stat] += ms;
+        used[stat] = true;
+
+        if (!stats[stat].parent.empty())
+        {
+            int parent = statIndex[stats[stat].parent];
+            frameTime[parent] += ms;
+            used[parent] = true;
+        }
+    }
+
+    for (unsigned int i = 0; i < stats.size(); ++i)
+    {
+        if (used[i]) AddSample(stats[i], frameTime[i]);
+    }
+}
+
+void GpuTimer::DrawWindow()
+{
+    static bool firstOpen = true;
+    static char csvPath[256] = "gpu_timings.csv";
+    static std::string exportStatus;
+
+    if (firstOpen) {
+        ImGui::SetNextWindowSize(ImVec2(360, 220));
+        firstOpen = false;
+    }
+    ImGui::Begin("GPU Timings");
+
+    if (ImGui::BeginTable("gpuTimings", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+    {
+        ImGui::TableSetupColumn("Pass");
+        ImGui::TableSetupColumn("Last, ms");
+        ImGui::TableSetupColumn("Avg, ms");
+        ImGui::TableSetupColumn("Max, ms");
+        ImGui::TableHeadersRow();
+
+        for (unsigned int i = 0; i < stats.size(); ++i)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (stats[i].parent.empty()) ImGui::Text("%s", stats[i].name.c_str());
+            else ImGui::Text("  %s", stats[i].name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats[i].last);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats[i].average);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats[i].maximum);
+        }
+        ImGui::EndTable();
+    }
+
+    if (skippedFrames > 0) ImGui::Text("Frames dropped (GPU behind): %d", skippedFrames);
+
+    ImGui::InputText("##csvPath", csvPath, sizeof(csvPath));
+    ImGui::SameLine();
+    if (ImGui::Button("Export CSV"))
+        exportStatus = ExportCSV(csvPath) ? "Saved" : "Failed to write file";
+    if (!exportStatus.empty()) ImGui::Text("%s", exportStatus.c_str());
+
+    ImGui::End();
+}
+
+bool GpuTimer::ExportCSV(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::GPU_TIMER:: can't open " << path << std::endl;
+        return false;
+    }
+
+    file << "pass,parent,last_ms,avg_ms,max_ms,samples\n";
+    for (unsigned int i = 0; i < stats.size(); ++i)
+    {
+        file << "\"" << stats[i].name << "\",\"" << stats[i].parent << "\","
+             << stats[i].last << "," << stats[i].average << "," << stats[i].maximum << ","
+             << stats[i].historyCount << "\n";
+    }
+
+    return true;
+}
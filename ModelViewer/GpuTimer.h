@@ -0,0 +1,70 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+// Measures GPU time of render passes with GL_TIME_ELAPSED queries.
+// Results are read back FRAME_LATENCY frames later, so the CPU never waits on the GPU.
+class GpuTimer
+{
+public:
+    // frames between issuing a query and reading its result back
+    static const int FRAME_LATENCY = 4;
+    // samples kept for the rolling average/maximum
+    static const int HISTORY_SIZE = 120;
+
+    struct Stat {
+        std::string name;
+        std::string parent;             // parent pass, its time is the sum of its children
+        float history[HISTORY_SIZE] = {};
+        int historyCount = 0, historyPos = 0;
+        float last = 0.0f, average = 0.0f, maximum = 0.0f;
+    };
+
+    // collects finished queries of an old frame, call once at the start of a frame
+    void BeginFrame();
+    void EndFrame();
+
+    // time queries can't be nested, every Begin must be closed by End before the next one
+    void Begin(const std::string& name, const std::string& parent = "");
+    void End();
+
+    // ImGui window with the rolling averages/maxima
+    void DrawWindow();
+
+    bool ExportCSV(const std::string& path);
+
+    // forgets a pass that won't run again, e.g. the row of a deleted model
+    void RemoveStat(const std::string& name);
+
+    const std::vector<Stat>& GetStats() { return stats; }
+
+private:
+    struct PendingQuery {
+        GLuint query;
+        int stat;   // -1 once the stat was removed
+    };
+
+    struct FrameSlot {
+        std::vector<GLuint> pool;           // query objects owned by the slot, reused each time
+        std::vector<PendingQuery> pending;  // queries issued during the frame
+    };
+
+    int FindStat(const std::string& name, const std::string& parent);
+    void AddSample(Stat& stat, float ms);
+    void ResolveSlot(FrameSlot& slot);
+
+    FrameSlot slots[FRAME_LATENCY];
+    int frameIndex = 0;
+    bool active = false;
+
+    std::vector<Stat> stats;
+    std::map<std::string, int> statIndex;
+    int skippedFrames = 0;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+thread_local bool JobSystem::insideLoop = false;
+
+JobSystem& JobSystem::Get()
+{
+    static JobSystem jobSystem;
+    return jobSystem;
+}
+
+JobSystem::JobSystem()
+{
+    int threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    shares = std::vector<Share>(threads + 1);
+    for (int i = 0; i < threads; ++i)
+        workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (unsigned int i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+void JobSystem::ParallelFor(int count, int grain, const std::function<void(int, int)>& func)
+{
+    if (count <= 0) return;
+    grain = std::max(grain, 1);
+
+    // not worth waking anybody, or called from a range of the running loop
+    if (workers.empty() || count <= grain || insideLoop)
+    {
+        func(0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> loopLock(loopMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loopFunc = &func;
+        loopCount = count;
+        loopGrain = grain;
+
+        // contiguous shares keep neighbouring items on the same thread
+        int ranges = (count + grain - 1) / grain;
+        int threads = static_cast<int>(shares.size());
+        for (int i = 0; i < threads; ++i)
+            shares[i].ranges.store(Pack(static_cast<unsigned int>(static_cast<long long>(ranges) * i / threads),
+                                        static_cast<unsigned int>(static_cast<long long>(ranges) * (i + 1) / threads)));
+        loopPending.store(ranges);
+        generation++;
+    }
+    wake.notify_all();
+
+    RunRanges(0);
+
+    // wait for the ranges other threads took, and for every worker to let go of loopFunc
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return loopPending.load() == 0 && busyWorkers == 0; });
+    loopFunc = nullptr;
+}
+
+void JobSystem::RunRanges(int slot)
+{
+    int range;
+    while (PopRange(slot, range) || StealRange(slot, range))
+    {
+        int begin = range * loopGrain;
+        insideLoop = true;
+        (*loopFunc)(begin, std::min(begin + loopGrain, loopCount));
+        insideLoop = false;
+        loopPending.fetch_sub(1);
+    }
+}
+
+bool JobSystem::PopRange(int slot, int& range)
+{
+    std::atomic<unsigned long long>& ranges = shares[slot].ranges;
+    unsigned long long current = ranges.load();
+    while (true)
+    {
+        unsigned int first = static_cast<unsigned int>(current >> 32), end = static_cast<unsigned int>(current);
+        if (first >= end) return false;
+        if (ranges.compare_exchange_weak(current, Pack(first + 1, end)))
+        {
+            range = static_cast<int>(first);
+            return true;
+        }
+    }
+}
+
+bool JobSystem::StealRange(int slot, int& range)
+{
+    int threads = static_cast<int>(shares.size());
+    for (int i = 1; i < threads; ++i)
+    {
+        std::atomic<unsigned long long>& victim = shares[(slot + i) % threads].ranges;
+        unsigned long long current = victim.load();
+        while (true)
+        {
+            unsigned int first = static_cast<unsigned int>(current >> 32), end = static_cast<unsigned int>(current);
+            if (first >= end) break;
+
+            // the back half, the owner keeps working from the front
+            unsigned int middle = first + (end - first) / 2;
+            if (victim.compare_exchange_weak(current, Pack(first, middle)))
+            {
+                // our share is empty, nobody else can change it until it holds something
+                shares[slot].ranges.store(Pack(middle + 1, end));
+                range = static_cast<int>(middle);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+    PROFILE_THREAD("Worker " + std::to_string(index));
+
+    unsigned long long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quit || (generation != seen && loopFunc); });
+            if (quit) return;
+            seen = generation;
+            busyWorkers++;
+        }
+
+        RunRanges(index + 1);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        done.notify_all();
+    }
+}
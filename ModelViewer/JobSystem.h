@@ -0,0 +1,59 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads for data parallel loops. The calling thread works on the loop too.
+// Every thread starts on its own contiguous share of the ranges and steals half of another thread's
+// remaining share when it runs out, so uneven items still spread over all threads.
+class JobSystem
+{
+public:
+    static JobSystem& Get();
+
+    ~JobSystem();
+
+    // calls func(begin, end) on ranges of at most `grain` items until [0, count) is covered, returns when all are done.
+    // A ParallelFor inside func runs its loop on the calling thread
+    void ParallelFor(int count, int grain, const std::function<void(int, int)>& func);
+
+    int GetThreadCount() { return static_cast<int>(workers.size()) + 1; }
+
+private:
+    JobSystem();
+
+    void WorkerLoop(int index);
+    // takes ranges of the current loop until none are left, slot is the thread's own share
+    void RunRanges(int slot);
+    bool PopRange(int slot, int& range);
+    bool StealRange(int slot, int& range);
+
+    // [first, end) of the ranges a thread still owns, packed into one word so it can be split with one CAS
+    struct alignas(64) Share {
+        std::atomic<unsigned long long> ranges{ 0 };
+    };
+    static unsigned long long Pack(unsigned int first, unsigned int end) { return (static_cast<unsigned long long>(first) << 32) | end; }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool quit = false;
+
+    // the loop being executed
+    std::mutex loopMutex;   // one ParallelFor at a time
+    static thread_local bool insideLoop;    // the thread is running a range, nested loops must not wait on loopMutex
+    const std::function<void(int, int)>* loopFunc = nullptr;
+    int loopCount = 0, loopGrain = 1;
+    std::vector<Share> shares;  // one per thread, the calling thread is 0
+    std::atomic<int> loopPending{ 0 };
+    unsigned long long generation = 0;
+    int busyWorkers = 0;
+};
+
+#endif
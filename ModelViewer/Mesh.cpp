@@ -1,16 +1,152 @@
 #include "Mesh.h"
+#include "MeshSimplifier.h"
+#include "Profiler.h"
+#include "JobSystem.h"
 
-Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+#include <queue>
+
+Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload)
 {
     this->vertices = vertices;
     this->indices = indices;
     this->textures = textures;
 
+    CalculateBounds();
+    BuildLods();
+    BuildClusters();
+
     // now that we have all the required data, set the vertex buffers and its attribute pointers.
-    setupMesh();
+    if (upload) setupMesh();
+}
+
+void Mesh::Upload()
+{
+    if (!VAO) setupMesh();
+}
+
+void Mesh::Release()
+{
+    if (VAO)
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = 0;
+    }
+    if (skinnedVAO)
+    {
+        glDeleteVertexArrays(1, &skinnedVAO);
+        glDeleteBuffers(1, &skinnedVBO);
+        skinnedVAO = skinnedVBO = 0;
+    }
+    preSkinned = false;
 }
 
 void Mesh::Draw(Shader& shader)
+{
+    Draw(shader, 0);
+}
+
+void Mesh::Draw(Shader& shader, int lod)
+{
+    BindTextures(shader);
+
+    // draw mesh
+    glBindVertexArray(preSkinned ? skinnedVAO : VAO);
+    glDrawElements(GL_TRIANGLES, lods[lod].indexCount, GL_UNSIGNED_INT, (void*)(lods[lod].indexOffset * sizeof(unsigned int)));
+    glBindVertexArray(0);
+
+    renderStats.drawCalls++;
+    renderStats.triangles += lods[lod].indexCount / 3;
+    renderStats.meshesPerLod[lod]++;
+    renderStats.trianglesPerLod[lod] += lods[lod].indexCount / 3;
+
+    // always good practice to set everything back to defaults once configured.
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::DrawInstanced(Shader& shader, int count)
+{
+    BindTextures(shader);
+
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, lods[0].indexCount, GL_UNSIGNED_INT, (void*)(lods[0].indexOffset * sizeof(unsigned int)), count);
+    glBindVertexArray(0);
+
+    renderStats.drawCalls++;
+    renderStats.triangles += static_cast<long long>(lods[0].indexCount / 3) * count;
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::DrawClusters(Shader& shader, const Frustum& frustum, const glm::vec3& cameraPos)
+{
+    int count = static_cast<int>(clusters.size());
+    clusterVisible.resize(count);
+
+    {
+        PROFILE_SCOPE("Mesh::CullClusters");
+        JobSystem::Get().ParallelFor(count, 1024, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                const MeshCluster& cluster = clusters[i];
+                bool visible = frustum.IntersectsSphere(cluster.sphere.center, cluster.sphere.radius);
+
+                // backfacing if the camera sees every normal of the cone from behind
+                glm::vec3 toCluster = cluster.sphere.center - cameraPos;
+                if (visible && clusterSettings.coneCulling && glm::dot(toCluster, cluster.coneAxis) >= cluster.coneCutoff * glm::length(toCluster) + cluster.sphere.radius)
+                    visible = false;
+
+                clusterVisible[i] = visible;
+            }
+        });
+    }
+
+    // neighbouring visible clusters are merged into one range
+    drawCounts.clear();
+    drawOffsets.clear();
+    unsigned int triangles = 0;
+    int visibleClusters = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!clusterVisible[i]) continue;
+
+        visibleClusters++;
+        triangles += clusters[i].indexCount / 3;
+        if (i > 0 && clusterVisible[i - 1])
+            drawCounts.back() += clusters[i].indexCount;
+        else
+        {
+            drawCounts.push_back(clusters[i].indexCount);
+            drawOffsets.push_back((void*)(clusters[i].indexOffset * sizeof(unsigned int)));
+        }
+    }
+
+    renderStats.clusters += count;
+    renderStats.clustersVisible += visibleClusters;
+    renderStats.meshesPerLod[0]++;
+    renderStats.trianglesPerLod[0] += triangles;
+    if (drawCounts.empty()) return;
+
+    BindTextures(shader);
+
+    glBindVertexArray(preSkinned ? skinnedVAO : VAO);
+    glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(), static_cast<GLsizei>(drawCounts.size()));
+    glBindVertexArray(0);
+
+    renderStats.drawCalls++;
+    renderStats.triangles += triangles;
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::BindTextures(Shader& shader)
+{
+    BindTextures(shader, textures);
+}
+
+void Mesh::BindTextures(Shader& shader, const vector<Texture>& textures)
 {
     // bind appropriate textures
     unsigned int diffuseNr = 1;
@@ -37,14 +173,6 @@ void Mesh::Draw(Shader& shader)
         // and finally bind the texture
         glBindTexture(GL_TEXTURE_2D, textures[i].id);
     }
-
-    // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
 }
 
 void Mesh::setupMesh()
@@ -65,6 +193,12 @@ void Mesh::setupMesh()
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
+    SetVertexAttributes();
+    glBindVertexArray(0);
+}
+
+void Mesh::SetVertexAttributes()
+{
     // set the vertex attribute pointers
     // vertex Positions
     glEnableVertexAttribArray(0);
@@ -88,5 +222,201 @@ void Mesh::setupMesh()
     // weights
     glEnableVertexAttribArray(6);
     glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+}
+
+void Mesh::setupSkinnedBuffer()
+{
+    glGenVertexArrays(1, &skinnedVAO);
+    glGenBuffers(1, &skinnedVBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, skinnedVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3) * 2, NULL, GL_DYNAMIC_COPY);
+
+    glBindVertexArray(skinnedVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    SetVertexAttributes();
+    // skinned position and normal, interleaved as the feedback varyings
+    glBindBuffer(GL_ARRAY_BUFFER, skinnedVBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3) * 2, (void*)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3) * 2, (void*)sizeof(glm::vec3));
+    // bones are already applied
+    glDisableVertexAttribArray(5);
+    glDisableVertexAttribArray(6);
     glBindVertexArray(0);
 }
+
+void Mesh::Skin()
+{
+    if (!skinnedVAO) setupSkinnedBuffer();
+
+    glBindVertexArray(VAO);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, skinnedVBO);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(vertices.size()));
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+
+    preSkinned = true;
+    renderStats.skinnedVertices += static_cast<int>(vertices.size());
+}
+
+void Mesh::CalculateBounds()
+{
+    // bone slots are filled from the first one, so the used ones are always a prefix
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        while (boneInfluences < MAX_BONE_INFLUENCE && vertices[i].m_BoneIDs[boneInfluences] >= 0)
+            boneInfluences++;
+    }
+    skinned = boneInfluences > 0;
+
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        bounds.Expand(vertices[i].Position);
+
+    sphere.center = bounds.Center();
+    sphere.radius = 0.0f;
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        sphere.radius = glm::max(sphere.radius, glm::length(vertices[i].Position - sphere.center));
+}
+
+void Mesh::BuildLods()
+{
+    PROFILE_FUNCTION();
+
+    MeshLod base = { 0, static_cast<unsigned int>(indices.size()), 0.0f };
+    lods.push_back(base);
+
+    if (!lodSettings.enabled || indices.size() / 3 < lodSettings.minTriangles) return;
+
+    // every LOD is simplified from the previous one, it's cheaper and keeps the chain consistent
+    vector<unsigned int> source(indices);
+    for (int i = 1; i < MAX_MESH_LODS; ++i)
+    {
+        size_t target = static_cast<size_t>(base.indexCount / 3 * lodSettings.ratios[i]) * 3;
+        float error = 0.0f;
+        vector<unsigned int> simplified = MeshSimplifier::Simplify(vertices, source, target, lodSettings.errors[i], &error);
+
+        // not worth a LOD if it barely got smaller than the previous one
+        if (simplified.empty() || simplified.size() > source.size() * 0.85f) break;
+
+        MeshLod lod = { static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(simplified.size()), error };
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        lods.push_back(lod);
+
+        source.swap(simplified);
+    }
+}
+
+void Mesh::BuildClusters()
+{
+    // skinned meshes move away from their bind pose bounds, cluster culling would be wrong for them
+    unsigned int triangleCount = lods[0].indexCount / 3;
+    if (skinned || triangleCount < clusterSettings.minTriangles) return;
+
+    PROFILE_FUNCTION();
+
+    // triangles around every vertex
+    vector<unsigned int> adjacencyOffset(vertices.size() + 1, 0), adjacency(triangleCount * 3);
+    for (unsigned int i = 0; i < triangleCount * 3; ++i) adjacencyOffset[indices[i] + 1]++;
+    for (unsigned int i = 0; i < vertices.size(); ++i) adjacencyOffset[i + 1] += adjacencyOffset[i];
+    {
+        vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (unsigned int i = 0; i < triangleCount * 3; ++i) adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    // clusters grow breadth first over shared vertices, so they stay compact
+    vector<bool> assigned(triangleCount, false);
+    vector<unsigned int> clustered;
+    clustered.reserve(triangleCount * 3);
+    std::queue<unsigned int> frontier;
+    unsigned int seed = 0;
+
+    while (true)
+    {
+        while (seed < triangleCount && assigned[seed]) seed++;
+        if (seed == triangleCount) break;
+
+        MeshCluster cluster;
+        cluster.indexOffset = static_cast<unsigned int>(clustered.size());
+        frontier = std::queue<unsigned int>();
+        frontier.push(seed);
+        assigned[seed] = true;
+        unsigned int clusterTriangles = 0;
+
+        while (!frontier.empty() && clusterTriangles < clusterSettings.trianglesPerCluster)
+        {
+            unsigned int tri = frontier.front();
+            frontier.pop();
+            for (int k = 0; k < 3; ++k) clustered.push_back(indices[tri * 3 + k]);
+            clusterTriangles++;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int v = indices[tri * 3 + k];
+                for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; ++a)
+                {
+                    if (assigned[adjacency[a]]) continue;
+                    assigned[adjacency[a]] = true;
+                    frontier.push(adjacency[a]);
+                }
+            }
+        }
+        // triangles that were reached but didn't fit go back to the pool
+        while (!frontier.empty())
+        {
+            assigned[frontier.front()] = false;
+            seed = std::min(seed, frontier.front());
+            frontier.pop();
+        }
+        cluster.indexCount = clusterTriangles * 3;
+
+        // bounds and normal cone
+        AABB box;
+        glm::vec3 axis = glm::vec3(0.0f);
+        for (unsigned int i = cluster.indexOffset; i < cluster.indexOffset + cluster.indexCount; i += 3)
+        {
+            glm::vec3 p0 = vertices[clustered[i]].Position, p1 = vertices[clustered[i + 1]].Position, p2 = vertices[clustered[i + 2]].Position;
+            box.Expand(p0); box.Expand(p1); box.Expand(p2);
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            if (glm::length(normal) > 0.0f) axis += glm::normalize(normal);
+        }
+
+        cluster.sphere.center = box.Center();
+        cluster.sphere.radius = 0.0f;
+        for (unsigned int i = cluster.indexOffset; i < cluster.indexOffset + cluster.indexCount; ++i)
+            cluster.sphere.radius = glm::max(cluster.sphere.radius, glm::length(vertices[clustered[i]].Position - cluster.sphere.center));
+
+        cluster.coneAxis = glm::length(axis) > 0.0f ? glm::normalize(axis) : glm::vec3(0.0f, 0.0f, 1.0f);
+        float minDot = 1.0f;
+        for (unsigned int i = cluster.indexOffset; i < cluster.indexOffset + cluster.indexCount; i += 3)
+        {
+            glm::vec3 p0 = vertices[clustered[i]].Position, p1 = vertices[clustered[i + 1]].Position, p2 = vertices[clustered[i + 2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            if (glm::length(normal) > 0.0f) minDot = glm::min(minDot, glm::dot(glm::normalize(normal), cluster.coneAxis));
+        }
+        // wider than a half sphere: never backfacing as a whole
+        cluster.coneCutoff = minDot <= 0.0f ? 1.0f : glm::sqrt(1.0f - minDot * minDot);
+        if (minDot <= 0.0f) cluster.coneAxis = glm::vec3(0.0f);
+
+        clusters.push_back(cluster);
+    }
+
+    std::copy(clustered.begin(), clustered.end(), indices.begin());
+}
+
+int Mesh::SelectLod(float screenSize)
+{
+    int lod = glm::min(currentLod, static_cast<int>(lods.size()) - 1);
+    float h = lodSettings.hysteresis;
+
+    // coarser while the mesh is clearly below the switch size, finer while it's clearly above
+    while (lod + 1 < static_cast<int>(lods.size()) && screenSize < lodSettings.screenSizes[lod + 1] * (1.0f - h))
+        lod++;
+    while (lod > 0 && screenSize > lodSettings.screenSizes[lod] * (1.0f + h))
+        lod--;
+
+    currentLod = lod;
+    return lod;
+}
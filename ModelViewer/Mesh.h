@@ -7,6 +7,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "Bounds.h"
+#include "RenderStats.h"
 
 #include <string>
 #include <vector>
@@ -37,25 +39,131 @@ struct Texture {
     string path;
 };
 
+// range of the index buffer used by one level of detail
+struct MeshLod {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float error;                // simplification error relative to the mesh radius
+};
+
+// LOD generation and selection settings, LOD 0 is always the source mesh
+struct LodSettings {
+    bool enabled = true;
+    // meshes with fewer triangles are not simplified
+    unsigned int minTriangles = 256;
+    // target triangle ratio and maximum error (relative to the mesh radius) of every LOD
+    float ratios[MAX_MESH_LODS] = { 1.0f, 0.5f, 0.25f, 0.1f };
+    float errors[MAX_MESH_LODS] = { 0.0f, 0.01f, 0.03f, 0.08f };
+    // projected diameter in pixels below which a LOD is used
+    float screenSizes[MAX_MESH_LODS] = { 0.0f, 400.0f, 160.0f, 60.0f };
+    // relative band around the switch size that has to be crossed before the LOD changes back
+    float hysteresis = 0.15f;
+};
+
+inline LodSettings lodSettings;
+
+// group of neighbouring triangles of LOD 0 that is culled as a whole
+struct MeshCluster {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    BoundingSphere sphere;
+    // every triangle normal is within the cone, coneCutoff is the sine of its half angle (1 - cone can't be used)
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+struct ClusterSettings {
+    bool enabled = true;
+    // faces aren't culled by GL, so this hides the back side of open surfaces
+    bool coneCulling = true;
+    // meshes with fewer triangles are drawn in one call
+    unsigned int minTriangles = 65536;
+    unsigned int trianglesPerCluster = 96;
+};
+
+inline ClusterSettings clusterSettings;
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
-    vector<unsigned int> indices;
+    vector<unsigned int> indices;       // index lists of all LODs one after another
     vector<Texture>      textures;
-    unsigned int VAO;
+    vector<MeshLod>      lods;
+    vector<MeshCluster>  clusters;
+    unsigned int VAO = 0;
+
+    // bounds in model space, for skinned meshes it's the bind pose
+    AABB bounds;
+    BoundingSphere sphere;
+    // frame the scene BVH last found this mesh inside the view frustum
+    unsigned int visibleStamp = 0;
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures);
+    // without upload the GL buffers are created later by Upload(), so meshes can be built on other threads
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true);
+
+    // creates the GL buffers if the constructor didn't, needs the GL context
+    void Upload();
+    // deletes the GL buffers, the CPU side data stays
+    void Release();
 
     // render the mesh
     void Draw(Shader& shader);
+    void Draw(Shader& shader, int lod);
+    // full detail, count instances of the bind pose layout, the shader places them by gl_InstanceID
+    void DrawInstanced(Shader& shader, int count);
+
+    // culls clusters against a frustum and camera position given in the mesh's model space,
+    // the rest is drawn with one multi draw call
+    void DrawClusters(Shader& shader, const Frustum& frustum, const glm::vec3& cameraPos);
+    bool HasClusters() { return clusterSettings.enabled && !clusters.empty(); }
+    bool IsSkinned() { return skinned; }
+    // most bone slots used by a vertex, 0 for static meshes
+    int GetBoneInfluences() { return boneInfluences; }
+
+    // transform feedback pre-skinning: writes this frame's model space positions and normals into a buffer that
+    // later draws read with the static layout. Expects the skinning program in use and GL_RASTERIZER_DISCARD on
+    void Skin();
+    // back to skinning in the vertex shader of every draw
+    void ReleaseSkinned() { preSkinned = false; }
+    bool IsPreSkinned() { return preSkinned; }
+
+    // picks LOD from the projected diameter in pixels, keeps the current one inside the hysteresis band
+    int SelectLod(float screenSize);
+    int GetCurrentLod() { return currentLod; }
+
+    // binds textures to the sampler uniforms by their type, diffuse1, diffuse2...
+    static void BindTextures(Shader& shader, const vector<Texture>& textures);
+    // attribute pointers of the Vertex layout for the bound VAO and array buffer
+    static void SetVertexAttributes();
 
 private:
+    int currentLod = 0;
+    bool skinned = false;
+    int boneInfluences = 0;
+    bool preSkinned = false;
+
+    // per frame cluster culling results, kept to avoid allocations
+    vector<unsigned char> clusterVisible;
+    vector<GLsizei> drawCounts;
+    vector<void*> drawOffsets;
+
     // render data 
     unsigned int VBO, EBO;
+    // transform feedback output, the VAO takes position and normal from it and the rest from VBO
+    unsigned int skinnedVAO = 0, skinnedVBO = 0;
 
     // initializes all the buffer objects/arrays
     void setupMesh();
+    void setupSkinnedBuffer();
+
+    void CalculateBounds();
+    // appends simplified index lists to indices
+    void BuildLods();
+    // splits LOD 0 into clusters of neighbouring triangles, reorders its indices so every cluster is one range
+    void BuildClusters();
+
+    void BindTextures(Shader& shader);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+
+void MeshSimplifier::AddPlane(Quadric& q, const glm::dvec4& p, double weight)
+{
+    q.a2 += p.x * p.x * weight; q.ab += p.x * p.y * weight; q.ac += p.x * p.z * weight; q.ad += p.x * p.w * weight;
+    q.b2 += p.y * p.y * weight; q.bc += p.y * p.z * weight; q.bd += p.y * p.w * weight;
+    q.c2 += p.z * p.z * weight; q.cd += p.z * p.w * weight;
+    q.d2 += p.w * p.w * weight;
+    q.weight += weight;
+}
+
+void MeshSimplifier::AddQuadric(Quadric& q, const Quadric& o)
+{
+    q.a2 += o.a2; q.ab += o.ab; q.ac += o.ac; q.ad += o.ad;
+    q.b2 += o.b2; q.bc += o.bc; q.bd += o.bd;
+    q.c2 += o.c2; q.cd += o.cd;
+    q.d2 += o.d2;
+    q.weight += o.weight;
+}
+
+double MeshSimplifier::Evaluate(const Quadric& q, const glm::vec3& v)
+{
+    double x = v.x, y = v.y, z = v.z;
+    // squared distance to the accumulated planes: p^T Q p with p = (x, y, z, 1), averaged over the plane weights
+    // so the result is a length squared whatever the triangle areas were
+    double error = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+                 + q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+                 + q.c2 * z * z + 2.0 * q.cd * z
+                 + q.d2;
+    if (q.weight > 0.0) error /= q.weight;
+    return std::max(error, 0.0);
+}
+
+float MeshSimplifier::SkinDistance(const Vertex& a, const Vertex& b)
+{
+    float shared = 0.0f;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
+    {
+        if (a.m_BoneIDs[i] < 0) continue;
+        for (int j = 0; j < MAX_BONE_INFLUENCE; ++j)
+        {
+            if (a.m_BoneIDs[i] == b.m_BoneIDs[j])
+                shared += std::min(a.m_Weights[i], b.m_Weights[j]);
+        }
+    }
+    return 1.0f - std::min(shared, 1.0f);
+}
+
+std::vector<unsigned int> MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                                   size_t targetIndexCount, float targetError, float* resultError)
+{
+    std::vector<unsigned int> result = indices;
+    size_t vertexCount = vertices.size();
+    if (resultError) *resultError = 0.0f;
+    if (vertexCount == 0 || indices.size() <= targetIndexCount) return result;
+
+    // mesh size, the error target is relative to it
+    glm::vec3 minPoint = vertices[0].Position, maxPoint = vertices[0].Position;
+    bool skinned = false;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        minPoint = glm::min(minPoint, vertices[i].Position);
+        maxPoint = glm::max(maxPoint, vertices[i].Position);
+        skinned = skinned || vertices[i].m_BoneIDs[0] >= 0;
+    }
+    double radius = glm::length(maxPoint - minPoint) * 0.5;
+    double errorLimit = targetError * radius;
+    double errorLimitSq = errorLimit * errorLimit;
+
+    // open edges: a directed edge without its opposite. Both ends of such edge are locked in place.
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::unordered_map<unsigned long long, int> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                unsigned long long a = indices[i + e], b = indices[i + (e + 1) % 3];
+                edges[(a << 32) | b]++;
+            }
+        }
+        for (auto& edge : edges)
+        {
+            unsigned long long a = edge.first >> 32, b = edge.first & 0xffffffffull;
+            if (edges.find((b << 32) | a) == edges.end())
+                locked[a] = locked[b] = true;
+        }
+    }
+
+    // error quadrics of the planes around every vertex
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        glm::dvec3 p0 = vertices[indices[i]].Position, p1 = vertices[indices[i + 1]].Position, p2 = vertices[indices[i + 2]].Position;
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(normal);
+        if (area <= 0.0) continue;
+        normal /= area;
+
+        glm::dvec4 plane = glm::dvec4(normal, -glm::dot(normal, p0));
+        for (int k = 0; k < 3; ++k)
+            AddPlane(quadrics[indices[i + k]], plane, area * 0.5);
+    }
+
+    std::vector<unsigned int> remap(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) remap[i] = static_cast<unsigned int>(i);
+
+    struct Collapse {
+        unsigned int from, to;
+        double error;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(vertexCount);
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1), adjacency;
+    double reachedError = 0.0;
+
+    while (result.size() > targetIndexCount)
+    {
+        // triangles around every vertex
+        std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+        for (size_t i = 0; i < result.size(); ++i) adjacencyOffset[result[i] + 1]++;
+        for (size_t i = 0; i < vertexCount; ++i) adjacencyOffset[i + 1] += adjacencyOffset[i];
+        adjacency.resize(result.size());
+        {
+            std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i)
+                adjacency[fill[result[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        // cheapest direction of every edge
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                unsigned int a = result[i + e], b = result[i + (e + 1) % 3];
+                if (a > b) continue;    // every inner edge is seen twice
+
+                Collapse best = { a, b, -1.0 };
+                for (int dir = 0; dir < 2; ++dir)
+                {
+                    unsigned int from = dir ? b : a, to = dir ? a : b;
+                    if (locked[from]) continue;
+                    if (skinned && SkinDistance(vertices[from], vertices[to]) > 0.25f) continue;
+
+                    Quadric q = quadrics[from];
+                    AddQuadric(q, quadrics[to]);
+                    double error = Evaluate(q, vertices[to].Position);
+                    if (best.error < 0.0 || error < best.error)
+                        best = { from, to, error };
+                }
+                if (best.error >= 0.0 && best.error <= errorLimitSq) collapses.push_back(best);
+            }
+        }
+        if (collapses.empty()) break;
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.error < r.error; });
+
+        // every collapse removes about two triangles
+        size_t collapseBudget = (result.size() - targetIndexCount) / 6 + 1;
+        size_t collapsed = 0;
+        std::fill(touched.begin(), touched.end(), false);
+
+        for (size_t c = 0; c < collapses.size() && collapsed < collapseBudget; ++c)
+        {
+            const Collapse& collapse = collapses[c];
+            unsigned int from = collapse.from, to = collapse.to;
+            if (touched[from] || touched[to]) continue;
+
+            // moving `from` onto `to` must not flip any remaining triangle
+            bool flips = false;
+            for (unsigned int t = adjacencyOffset[from]; t < adjacencyOffset[from + 1] && !flips; ++t)
+            {
+                unsigned int tri = adjacency[t] * 3;
+                unsigned int v[3] = { remap[result[tri]], remap[result[tri + 1]], remap[result[tri + 2]] };
+                if (v[0] == to || v[1] == to || v[2] == to) continue;   // becomes degenerate, removed
+
+                glm::vec3 before = glm::cross(vertices[v[1]].Position - vertices[v[0]].Position, vertices[v[2]].Position - vertices[v[0]].Position);
+                for (int k = 0; k < 3; ++k)
+                    if (v[k] == from) v[k] = to;
+                glm::vec3 after = glm::cross(vertices[v[1]].Position - vertices[v[0]].Position, vertices[v[2]].Position - vertices[v[0]].Position);
+
+                if (glm::dot(before, after) <= 0.0f) flips = true;
+            }
+            if (flips) continue;
+
+            remap[from] = to;
+            AddQuadric(quadrics[to], quadrics[from]);
+            reachedError = std::max(reachedError, collapse.error);
+
+            // neighbours of both ends changed, they're re-evaluated in the next pass
+            touched[from] = touched[to] = true;
+            for (unsigned int t = adjacencyOffset[from]; t < adjacencyOffset[from + 1]; ++t)
+            {
+                unsigned int tri = adjacency[t] * 3;
+                for (int k = 0; k < 3; ++k) touched[remap[result[tri + k]]] = true;
+            }
+            collapsed++;
+        }
+        if (collapsed == 0) break;
+
+        // apply the collapses and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (resultError) *resultError = radius > 0.0 ? static_cast<float>(std::sqrt(reachedError) / radius) : 0.0f;
+    return result;
+}
@@ -0,0 +1,34 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <vector>
+
+#include "Mesh.h"
+
+// Quadric error mesh simplification with half-edge collapses.
+// A vertex is only ever moved onto one of its neighbours, so the kept vertices keep all their attributes
+// (uv, tangents, bone ids and weights) and the vertex buffer can be shared between LODs.
+// Vertices on open edges (mesh borders and uv/normal seams) are never moved.
+class MeshSimplifier
+{
+public:
+    // returns a new index list with at most targetIndexCount indices if that can be reached within targetError,
+    // targetError is relative to the mesh radius. The error that was reached is written to resultError.
+    static std::vector<unsigned int> Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                              size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+private:
+    struct Quadric {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        double weight;  // sum of the plane weights, Evaluate divides by it
+    };
+
+    static void AddPlane(Quadric& q, const glm::dvec4& plane, double weight);
+    static void AddQuadric(Quadric& q, const Quadric& other);
+    static double Evaluate(const Quadric& q, const glm::vec3& p);
+
+    // how different the bone influences of two vertices are, 0 - same, 1 - nothing in common
+    static float SkinDistance(const Vertex& a, const Vertex& b);
+};
+
+#endif
@@ -1,19 +1,144 @@
 #include "Model.h"
+#include "Profiler.h"
+#include "OcclusionCuller.h"
 #include <algorithm>
 
-Model::Model(string const& path, bool moveable, bool gamma) : gammaCorrection(gamma), moveable(moveable)
+Model::Model(string const& path, bool moveable, bool gamma, bool deferUpload) : gammaCorrection(gamma), moveable(moveable), deferUpload(deferUpload)
 {
     loadModel(path);
 
     CalculateSize();
 }
 
+void Model::Upload()
+{
+    PROFILE_FUNCTION();
+
+    for (unsigned int i = 0; i < pendingImages.size(); i++)
+        textures_loaded[i].id = CreateTexture(pendingImages[i]);
+    pendingImages.clear();
+
+    // meshes hold copies of the textures, they get their ids by path
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+        {
+            for (unsigned int k = 0; k < textures_loaded.size(); k++)
+            {
+                if (textures_loaded[k].path == meshes[i].textures[j].path) meshes[i].textures[j].id = textures_loaded[k].id;
+            }
+        }
+        meshes[i].Upload();
+    }
+    deferUpload = false;
+}
+
+void Model::Release()
+{
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i].Release();
+    for (unsigned int i = 0; i < textures_loaded.size(); i++)
+    {
+        if (textures_loaded[i].id) glDeleteTextures(1, &textures_loaded[i].id);
+        textures_loaded[i].id = 0;
+    }
+    for (unsigned int i = 0; i < pendingImages.size(); i++)
+        stbi_image_free(pendingImages[i].data);
+    pendingImages.clear();
+}
+
+AABB Model::GetBounds()
+{
+    AABB bounds;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        if (meshes[i].bounds.IsValid()) bounds.Expand(meshes[i].bounds);
+    }
+    return bounds;
+}
+
 void Model::Draw(Shader& shader)
 {
     for (unsigned int i = 0; i < meshes.size(); i++)
         meshes[i].Draw(shader);
 }
 
+void Model::Draw(Shader& shader, const RenderView& view, const glm::mat4& modelMatrix)
+{
+    // uniform scale is enough for the bounding sphere radius
+    float scale = glm::max(glm::length(glm::vec3(modelMatrix[0])), glm::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+
+    // cluster culling happens in model space
+    Frustum modelFrustum = Frustum::FromMatrix(view.viewProj * modelMatrix);
+    glm::vec3 modelCameraPos = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(view.cameraPos, 1.0f));
+
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        // skinned meshes move away from the bounds the BVH has, they're drawn regardless
+        if (view.visibilityStamp && !meshes[i].IsSkinned() && meshes[i].visibleStamp != view.visibilityStamp)
+        {
+            renderStats.frustumCulled++;
+            continue;
+        }
+
+        // skinned meshes leave their bind pose bounds, they're never occlusion culled
+        if (view.occlusion && !meshes[i].IsSkinned())
+        {
+            renderStats.occlusionTested++;
+            if (!view.occlusion->IsVisible(meshes[i].bounds.Transformed(modelMatrix)))
+            {
+                renderStats.occlusionCulled++;
+                continue;
+            }
+        }
+
+        int lod = 0;
+        if (lodSettings.enabled)
+        {
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(meshes[i].sphere.center, 1.0f));
+            lod = meshes[i].SelectLod(view.ProjectedSize(center, meshes[i].sphere.radius * scale));
+        }
+        if (lod == 0 && meshes[i].HasClusters())
+            meshes[i].DrawClusters(shader, modelFrustum, modelCameraPos);
+        else
+            meshes[i].Draw(shader, lod);
+    }
+}
+
+std::string Model::GetShaderDefines()
+{
+    int influences = GetBoneInfluences();
+    if (influences == 0) return "";
+
+    // pre-skinned meshes are drawn from the transform feedback output with the static layout
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        if (meshes[i].IsSkinned() && meshes[i].IsPreSkinned()) return "";
+    }
+    return "SKINNED BONE_INFLUENCES=" + std::to_string(influences);
+}
+
+int Model::GetBoneInfluences()
+{
+    int influences = 0;
+    for (unsigned int i = 0; i < meshes.size() && animated; i++)
+        influences = glm::max(influences, meshes[i].GetBoneInfluences());
+
+    // 3 influences use the 4 variant, one variant less to compile
+    return influences <= 2 ? influences : 4;
+}
+
+long long Model::GetLodTriangleCount(int lod)
+{
+    long long triangles = 0;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        int meshLod = glm::min(lod, static_cast<int>(meshes[i].lods.size()) - 1);
+        triangles += meshes[i].lods[meshLod].indexCount / 3;
+    }
+    return triangles;
+}
+
 void Model::SetScaleVec(float scale)
 {
     this->scale.x = this->scale.y = this->scale.z = scale;
@@ -62,9 +187,15 @@ void Model::CalculateSize()
 
 void Model::loadModel(string const& path)
 {
+    PROFILE_FUNCTION();
+
     // read file via ASSIMP
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    const aiScene* scene = nullptr;
+    {
+        PROFILE_SCOPE("Assimp::ReadFile");
+        scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    }
     // check for errors
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
@@ -73,8 +204,10 @@ void Model::loadModel(string const& path)
     }
     // retrieve the directory path of the filepath
     directory = path.substr(0, path.find_last_of('/'));
+    name = path.substr(path.find_last_of('/') + 1);
 
     // process ASSIMP's root node recursively
+    PROFILE_SCOPE("Model::processNode");
     processNode(scene->mRootNode, scene);
 }
 
@@ -139,7 +272,7 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 
     ExtractBoneWeightForVertices(vertices, mesh, scene);
 
-    return Mesh(vertices, indices, textures);
+    return Mesh(vertices, indices, textures, !deferUpload);
 }
 
 vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
@@ -163,7 +296,13 @@ vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type,
         if (!skip)
         {   // if texture hasn't been loaded already, load it
             Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
+            if (deferUpload)
+            {
+                texture.id = 0;
+                pendingImages.push_back(LoadTextureImage(str.C_Str(), this->directory));
+            }
+            else
+                texture.id = TextureFromFile(str.C_Str(), this->directory);
             texture.type = typeName;
             texture.path = str.C_Str();
             textures.push_back(texture);
@@ -233,26 +372,43 @@ void Model::ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, aiMesh*
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
+    PROFILE_FUNCTION();
+
+    TextureImage image = LoadTextureImage(path, directory);
+    return CreateTexture(image);
+}
+
+TextureImage LoadTextureImage(const char* path, const string& directory)
+{
+    PROFILE_FUNCTION();
+
     string filename = string(path);
     filename = directory + '/' + filename;
 
+    TextureImage image;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0);
+    if (!image.data)
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    return image;
+}
+
+unsigned int CreateTexture(TextureImage& image)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.components == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.components == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.components == 4)
             format = GL_RGBA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -260,13 +416,9 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        stbi_image_free(image.data);
+        image.data = nullptr;
     }
 
     return textureID;
-}
\ No newline at end of file
+}
@@ -13,6 +13,7 @@
 #include "Mesh.h"
 #include "AssimpGlmHelpers.h"
 #include "Animdata.h"
+#include "RenderView.h"
 
 #include <string>
 #include <fstream>
@@ -24,6 +25,17 @@ using namespace std;
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+// decoded texture file, data is null if it couldn't be loaded
+struct TextureImage {
+    unsigned char* data = nullptr;
+    int width = 0, height = 0, components = 0;
+};
+
+// the loading half of TextureFromFile, doesn't need the GL context
+TextureImage LoadTextureImage(const char* path, const string& directory);
+// the GL half, frees the image data
+unsigned int CreateTexture(TextureImage& image);
+
 class Model
 {
 public:
@@ -31,13 +43,34 @@ public:
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
+    string name;        // file name, used to label the model in the tools windows
     bool gammaCorrection;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool moveable, bool gamma = false);
+    // With deferUpload no GL calls are made, so it can run on a worker thread, Upload() then has to be called on the GL thread
+    Model(string const& path, bool moveable, bool gamma = false, bool deferUpload = false);
+
+    // creates textures and buffers of a model loaded with deferUpload
+    void Upload();
+    // deletes all textures and buffers of the model
+    void Release();
+
+    // union of the model space bounds of all meshes
+    AABB GetBounds();
 
     // draws the model, and thus all its meshes
     void Draw(Shader& shader);
+    // draws every mesh at the LOD that fits its size on screen
+    void Draw(Shader& shader, const RenderView& view, const glm::mat4& modelMatrix);
+
+    // triangles of all meshes at the given LOD, meshes without that LOD count with their coarsest one
+    long long GetLodTriangleCount(int lod);
+
+    // vertex shader defines for this model, skinning with the fewest bone slots its meshes need.
+    // Empty for static and pre-skinned models
+    std::string GetShaderDefines();
+    // bone slots the skinning shader has to loop over, 1, 2 or 4. 0 if nothing is skinned
+    int GetBoneInfluences();
 
     auto& GetBoneInfoMap() { return m_BoneInfoMap; }
     int& GetBoneCount() { return m_BoneCounter; }
@@ -86,6 +119,9 @@ private:
 
     // model properties 
     bool moveable = false, animated = false;
+    bool deferUpload = false;
+    // decoded images of textures_loaded waiting for Upload()
+    vector<TextureImage> pendingImages;
     glm::vec3 scale, position, size, center;
 
     // -----------------------
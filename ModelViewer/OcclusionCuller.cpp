@@ -0,0 +1,217 @@
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+// triangles closer than this (clip w) aren't rasterized, dropping an occluder is always safe
+const float NEAR_W = 0.001f;
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProj)
+{
+    this->viewProj = viewProj;
+    triangles.clear();
+    occluderCount = 0;
+
+    if (levels.empty())
+    {
+        for (int w = WIDTH, h = HEIGHT; w >= 1 && h >= 1; w /= 2, h /= 2)
+            levels.push_back(std::vector<float>(w * h));
+    }
+    std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+}
+
+void OcclusionCuller::AddOccluder(const void* positions, size_t stride, const unsigned int* indices, size_t indexCount, const glm::mat4& modelMatrix)
+{
+    glm::mat4 mvp = viewProj * modelMatrix;
+    occluderCount++;
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        ScreenTriangle tri;
+        bool clipped = false;
+        for (int k = 0; k < 3; ++k)
+        {
+            const glm::vec3& p = *reinterpret_cast<const glm::vec3*>(static_cast<const char*>(positions) + indices[i + k] * stride);
+            glm::vec4 clip = mvp * glm::vec4(p, 1.0f);
+            if (clip.w < NEAR_W)
+            {
+                clipped = true;
+                break;
+            }
+            tri.x[k] = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+            tri.y[k] = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+            tri.z[k] = clip.z / clip.w * 0.5f + 0.5f;
+        }
+        if (clipped) continue;
+
+        float minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+        float maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+        float minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+        float maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+        if (maxY < 0.0f || minY >= HEIGHT || maxX < 0.0f || minX >= WIDTH) continue;
+
+        tri.minY = std::max(0, static_cast<int>(minY));
+        tri.maxY = std::min(HEIGHT - 1, static_cast<int>(maxY));
+        triangles.push_back(tri);
+    }
+}
+
+void OcclusionCuller::Rasterize()
+{
+    PROFILE_FUNCTION();
+
+    JobSystem::Get().ParallelFor(BANDS, 1, [this](int begin, int end)
+    {
+        for (int band = begin; band < end; ++band)
+            RasterizeBand(band);
+    });
+
+    BuildPyramid();
+}
+
+void OcclusionCuller::RasterizeBand(int band)
+{
+    int rows = HEIGHT / BANDS;
+    int minRow = band * rows, maxRow = minRow + rows - 1;
+
+    for (unsigned int i = 0; i < triangles.size(); ++i)
+    {
+        if (triangles[i].maxY < minRow || triangles[i].minY > maxRow) continue;
+        RasterizeTriangle(triangles[i], std::max(minRow, triangles[i].minY), std::min(maxRow, triangles[i].maxY));
+    }
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& t, int minRow, int maxRow)
+{
+    float x0 = t.x[0], y0 = t.y[0], x1 = t.x[1], y1 = t.y[1], x2 = t.x[2], y2 = t.y[2];
+    float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+    if (std::abs(area) < 1e-6f) return;
+
+    // both windings are occluders, flip clockwise ones
+    float z0 = t.z[0], z1 = t.z[1], z2 = t.z[2];
+    if (area < 0.0f)
+    {
+        std::swap(x1, x2); std::swap(y1, y2); std::swap(z1, z2);
+        area = -area;
+    }
+
+    // edge functions e(x, y) = a * x + b * y + c, positive inside
+    float a0 = y1 - y2, b0 = x2 - x1, c0 = x1 * y2 - x2 * y1;
+    float a1 = y2 - y0, b1 = x0 - x2, c1 = x2 * y0 - x0 * y2;
+    float a2 = y0 - y1, b2 = x1 - x0, c2 = x0 * y1 - x1 * y0;
+
+    // depth is linear in screen space: z = e0 * z0 + e1 * z1 + e2 * z2 with normalized edge values
+    float invArea = 1.0f / area;
+    float za = (a0 * z0 + a1 * z1 + a2 * z2) * invArea;
+    float zb = (b0 * z0 + b1 * z1 + b2 * z2) * invArea;
+    float zc = (c0 * z0 + c1 * z1 + c2 * z2) * invArea;
+
+    int minX = std::max(0, static_cast<int>(std::min(x0, std::min(x1, x2)))) & ~3;
+    int maxX = std::min(WIDTH - 1, static_cast<int>(std::max(x0, std::max(x1, x2))));
+
+    float* depth = levels[0].data();
+
+    for (int y = minRow; y <= maxRow; ++y)
+    {
+        float py = y + 0.5f;
+        float* row = depth + y * WIDTH;
+        int x = minX;
+
+#ifdef OCCLUSION_SSE
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        for (; x <= maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px), _mm_set1_ps(b0 * py + c0));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px), _mm_set1_ps(b1 * py + c1));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px), _mm_set1_ps(b2 * py + c2));
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if (_mm_movemask_ps(inside) == 0) continue;
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), _mm_set1_ps(zb * py + zc));
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 nearest = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+        }
+#else
+        for (; x <= maxX; ++x)
+        {
+            float px = x + 0.5f;
+            if (a0 * px + b0 * py + c0 < 0.0f || a1 * px + b1 * py + c1 < 0.0f || a2 * px + b2 * py + c2 < 0.0f)
+                continue;
+            float z = za * px + zb * py + zc;
+            if (z < row[x]) row[x] = z;
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+    for (unsigned int level = 1; level < levels.size(); ++level)
+    {
+        int w = WIDTH >> level, h = HEIGHT >> level, pw = w * 2;
+        const float* src = levels[level - 1].data();
+        float* dst = levels[level].data();
+
+        for (int y = 0; y < h; ++y)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                const float* s = src + (y * 2) * pw + x * 2;
+                dst[y * w + x] = std::max(std::max(s[0], s[1]), std::max(s[pw], s[pw + 1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::IsVisible(const AABB& box) const
+{
+    if (levels.empty() || triangles.empty()) return true;
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner = glm::vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+        glm::vec4 clip = viewProj * glm::vec4(corner, 1.0f);
+
+        // crosses the near plane, can't be behind anything
+        if (clip.w < NEAR_W) return true;
+
+        float x = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+        float y = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+        minZ = std::min(minZ, clip.z / clip.w * 0.5f + 0.5f);
+    }
+
+    // outside of the screen, that's for frustum culling to decide
+    if (maxX < 0.0f || maxY < 0.0f || minX >= WIDTH || minY >= HEIGHT) return true;
+
+    int x0 = std::max(0, static_cast<int>(minX)), x1 = std::min(WIDTH - 1, static_cast<int>(maxX));
+    int y0 = std::max(0, static_cast<int>(minY)), y1 = std::min(HEIGHT - 1, static_cast<int>(maxY));
+
+    // level where the rectangle covers at most 4x4 texels
+    int level = 0;
+    while (level + 1 < static_cast<int>(levels.size()) && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+        level++;
+
+    int w = WIDTH >> level;
+    const float* depth = levels[level].data();
+    for (int y = y0 >> level; y <= (y1 >> level); ++y)
+    {
+        for (int x = x0 >> level; x <= (x1 >> level); ++x)
+        {
+            if (minZ <= depth[y * w + x]) return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,53 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Bounds.h"
+
+// Software occlusion culling. A few big occluders are rasterized into a small depth buffer on the CPU (SSE2, row bands
+// in parallel), a max depth pyramid is built from it and bounding boxes are tested against the pyramid.
+// Doesn't touch GL at all.
+class OcclusionCuller
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int BANDS = 8;
+
+    // clears the depth buffer and the occluder list
+    void BeginFrame(const glm::mat4& viewProj);
+
+    // queues triangles of an occluder, positions are read with the given stride in bytes
+    void AddOccluder(const void* positions, size_t stride, const unsigned int* indices, size_t indexCount, const glm::mat4& modelMatrix);
+
+    // rasterizes the queued occluders and builds the depth pyramid
+    void Rasterize();
+
+    // false if the world space box is completely behind the occluders
+    bool IsVisible(const AABB& box) const;
+
+    int GetOccluderCount() const { return occluderCount; }
+    int GetTriangleCount() const { return static_cast<int>(triangles.size()); }
+    const float* GetDepth() const { return levels.empty() ? nullptr : levels[0].data(); }
+
+private:
+    struct ScreenTriangle {
+        float x[3], y[3], z[3];     // pixels and depth in [0, 1]
+        int minY, maxY;
+    };
+
+    void RasterizeBand(int band);
+    void RasterizeTriangle(const ScreenTriangle& tri, int minRow, int maxRow);
+    void BuildPyramid();
+
+    glm::mat4 viewProj;
+    std::vector<ScreenTriangle> triangles;
+    // levels[0] is the depth buffer, every next level keeps the farthest depth of 2x2 texels
+    std::vector<std::vector<float>> levels;
+    int occluderCount = 0;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "Pose.h"
+
+#include <cmath>
+
+void Pose::Resize(int nodeCount)
+{
+	positions.assign(nodeCount, glm::vec3(0.0f));
+	rotations.assign(nodeCount, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	scales.assign(nodeCount, glm::vec3(1.0f));
+}
+
+void Pose::SetTransform(int node, const Affine& transform)
+{
+	// node transforms are TRS without shear, the column lengths are the scale
+	glm::vec3 columns[3] = { transform.GetColumn(0), transform.GetColumn(1), transform.GetColumn(2) };
+	glm::vec3 scale(glm::length(columns[0]), glm::length(columns[1]), glm::length(columns[2]));
+	glm::mat3 rotation(columns[0] / glm::max(scale.x, 1e-8f), columns[1] / glm::max(scale.y, 1e-8f), columns[2] / glm::max(scale.z, 1e-8f));
+
+	positions[node] = transform.GetColumn(3);
+	rotations[node] = glm::normalize(glm::quat_cast(rotation));
+	scales[node] = scale;
+}
+
+void BlendPoses(const Pose& a, const Pose& b, float weight, const BoneMask* mask, Pose& out)
+{
+	int count = a.GetSize();
+	const float* masks = mask && !mask->IsEmpty() ? mask->weights.data() : nullptr;
+
+	for (int i = 0; i < count; ++i)
+	{
+		float t = masks ? weight * masks[i] : weight;
+		out.positions[i] = a.positions[i] + (b.positions[i] - a.positions[i]) * t;
+		out.scales[i] = a.scales[i] + (b.scales[i] - a.scales[i]) * t;
+	}
+
+	// nlerp on the short arc, close enough to slerp for the small angles between blended clips
+	for (int i = 0; i < count; ++i)
+	{
+		float t = masks ? weight * masks[i] : weight;
+		const glm::quat& qa = a.rotations[i];
+		glm::quat qb = b.rotations[i];
+		if (glm::dot(qa, qb) < 0.0f) qb = -qb;
+
+		glm::quat q(qa.w + (qb.w - qa.w) * t, qa.x + (qb.x - qa.x) * t, qa.y + (qb.y - qa.y) * t, qa.z + (qb.z - qa.z) * t);
+		float length = std::sqrt(glm::dot(q, q));
+		out.rotations[i] = length > 0.0f ? q / length : qa;
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef POSE_H
+#define POSE_H
+
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+
+#include "Affine.h"
+
+#include <string>
+#include <vector>
+
+// Local transform of every skeleton node as translation, rotation and scale, one array per component so blends
+// run over plain streams. Sized once when a clip starts playing, blending and sampling never allocate.
+struct Pose
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+
+	// identity transforms, only reallocates when the pose grows
+	void Resize(int nodeCount);
+	int GetSize() const { return static_cast<int>(positions.size()); }
+
+	// the TRS matrix of one node
+	Affine GetTransform(int node) const { return Affine::FromTRS(positions[node], rotations[node], scales[node]); }
+	void SetTransform(int node, const Affine& transform);
+};
+
+// how much a blend affects each skeleton node, a layer over the upper body masks everything else to 0
+struct BoneMask
+{
+	std::vector<float> weights;
+
+	bool IsEmpty() const { return weights.empty(); }
+};
+
+// out = a blended towards b by weight (times the mask weight of the node if a mask is given).
+// out may be a or b, all three have to be the same size
+void BlendPoses(const Pose& a, const Pose& b, float weight, const BoneMask* mask, Pose& out);
+
+#endif
@@ -0,0 +1,81 @@
+#include "PoseCache.h"
+
+#include <cstdint>
+
+static size_t HashKey(const Animation* clip, int frame)
+{
+	uint64_t h = reinterpret_cast<uintptr_t>(clip);
+	h = (h ^ (h >> 17)) * 0x9E3779B97F4A7C15ull;
+	h ^= static_cast<uint32_t>(frame) * 0x85EBCA6Bull;
+	return static_cast<size_t>(h ^ (h >> 29));
+}
+
+void PoseCache::Begin(float step)
+{
+	m_Step = step;
+	m_Used = 0;
+	m_Slots.assign(m_Slots.size(), -1);
+	m_Hits = 0;
+	m_Misses = 0;
+	m_SavedMilliseconds = 0.0f;
+}
+
+void PoseCache::Grow()
+{
+	m_Slots.assign(glm::max<size_t>(m_Slots.size() * 2, 64), -1);
+	size_t mask = m_Slots.size() - 1;
+	for (int i = 0; i < m_Used; ++i)
+	{
+		const PoseCacheEntry& entry = *m_Entries[i];
+		size_t s = HashKey(entry.clip, entry.frame) & mask;
+		while (m_Slots[s] >= 0) s = (s + 1) & mask;
+		m_Slots[s] = i;
+	}
+}
+
+PoseCacheEntry* PoseCache::Lookup(const Animation* clip, int frame, bool& owner)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	owner = false;
+	// at most half full, so probes stay short and always end at an empty slot
+	if ((m_Used + 1) * 2 > static_cast<int>(m_Slots.size())) Grow();
+
+	size_t mask = m_Slots.size() - 1;
+	for (size_t s = HashKey(clip, frame) & mask;; s = (s + 1) & mask)
+	{
+		int index = m_Slots[s];
+		if (index < 0)
+		{
+			if (m_Used == static_cast<int>(m_Entries.size())) m_Entries.push_back(std::make_unique<PoseCacheEntry>());
+			PoseCacheEntry* entry = m_Entries[m_Used].get();
+			entry->clip = clip;
+			entry->frame = frame;
+			entry->ready = false;
+			m_Slots[s] = m_Used++;
+			m_Misses++;
+			owner = true;
+			return entry;
+		}
+
+		PoseCacheEntry* entry = m_Entries[index].get();
+		if (entry->clip != clip || entry->frame != frame) continue;
+
+		// still being evaluated, the caller evaluates its own instead of waiting
+		if (!entry->ready)
+		{
+			m_Misses++;
+			return nullptr;
+		}
+		m_Hits++;
+		m_SavedMilliseconds += entry->milliseconds;
+		return entry;
+	}
+}
+
+void PoseCache::Publish(PoseCacheEntry* entry, float milliseconds)
+{
+	// the buffers were filled before, readers only touch them once ready is set under the lock
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	entry->milliseconds = milliseconds;
+	entry->ready = true;
+}
@@ -0,0 +1,66 @@
+#ifndef POSE_CACHE_H
+#define POSE_CACHE_H
+
+#include "Affine.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Animation;
+
+struct PoseCacheSettings
+{
+	bool enabled = false;
+	// seconds between cached poses, instances less than half a step apart share one
+	float step = 1.0f / 30.0f;
+};
+
+inline PoseCacheSettings poseCacheSettings;
+
+// one evaluated pose, the palette and the local transforms it was built from
+struct PoseCacheEntry
+{
+	const Animation* clip = nullptr;
+	int frame = 0;			// time / step
+	bool ready = false;
+	float milliseconds = 0.0f;	// cost of the evaluation, every hit saves about as much
+	std::vector<Affine> bones;
+	std::vector<Affine> locals;
+};
+
+// Full poses evaluated this frame keyed by (clip, quantized time). Instances playing a clip at nearly the
+// same time copy the palette of the first one instead of walking the hierarchy again. Lookups are thread safe, the
+// entries and their buffers are reused every frame so a warm cache doesn't allocate
+class PoseCache
+{
+public:
+	// forgets last frame's poses
+	void Begin(float step);
+	float GetStep() const { return m_Step; }
+
+	// the entry of the key. The first caller gets owner set, evaluates the pose into the entry and hands it to
+	// Publish. Returns nullptr while another thread is still evaluating it
+	PoseCacheEntry* Lookup(const Animation* clip, int frame, bool& owner);
+	void Publish(PoseCacheEntry* entry, float milliseconds);
+
+	int GetHits() const { return m_Hits; }
+	int GetMisses() const { return m_Misses; }
+	int GetPoseCount() const { return m_Used; }
+	float GetSavedMilliseconds() const { return m_SavedMilliseconds; }
+
+private:
+	void Grow();
+
+	std::mutex m_Mutex;
+	std::vector<std::unique_ptr<PoseCacheEntry>> m_Entries;
+	int m_Used = 0;
+	// open addressing over the used entries, -1 is empty
+	std::vector<int> m_Slots;
+	float m_Step = 1.0f / 30.0f;
+	int m_Hits = 0;
+	int m_Misses = 0;
+	float m_SavedMilliseconds = 0.0f;
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "Profiler.h"
+
+#include "imgui.h"
+
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+    struct ThreadBuffer {
+        std::string name;
+        int id = 0;
+        int depth = 0;
+        std::vector<Profiler::Event> events;
+        std::atomic<uint64_t> head{ 0 };    // total events written, the ring position is head % RING_SIZE
+    };
+
+    // buffers live until exit, so events of finished worker threads are still exported
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    thread_local ThreadBuffer* localBuffer = nullptr;
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    // frame boundaries, written by the main thread only
+    int64_t frameStarts[Profiler::FRAME_HISTORY];
+    uint64_t frameCount = 0;
+
+    // trace capture state
+    int captureFrames = 0, captureLeft = 0;
+    bool captureRestoreEnabled = false;
+    int64_t captureStart = 0;
+    std::string capturePath;
+    std::string captureStatus;
+
+    ThreadBuffer* GetLocalBuffer()
+    {
+        if (localBuffer) return localBuffer;
+
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        localBuffer = buffers.back().get();
+        localBuffer->id = static_cast<int>(buffers.size());
+        localBuffer->name = "Thread " + std::to_string(localBuffer->id);
+        localBuffer->events.resize(Profiler::RING_SIZE);
+        return localBuffer;
+    }
+
+    // copies events of a thread that overlap [from, to], oldest first
+    void CollectEvents(ThreadBuffer& buffer, int64_t from, int64_t to, std::vector<Profiler::Event>& out)
+    {
+        out.clear();
+        uint64_t head = buffer.head.load(std::memory_order_acquire);
+        uint64_t oldest = head > Profiler::RING_SIZE ? head - Profiler::RING_SIZE : 0;
+
+        // events are written in order of their end time, walk back until they end before `from`
+        for (uint64_t i = head; i > oldest; --i)
+        {
+            const Profiler::Event& e = buffer.events[(i - 1) % Profiler::RING_SIZE];
+            if (e.end < from) break;
+            if (e.start <= to) out.push_back(e);
+        }
+        std::reverse(out.begin(), out.end());
+    }
+}
+
+std::atomic<bool> Profiler::enabledFlag{ true };
+
+int64_t Profiler::Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+int& Profiler::ThreadDepth()
+{
+    return GetLocalBuffer()->depth;
+}
+
+void Profiler::Record(const char* name, int64_t start, int64_t end, int depth)
+{
+    ThreadBuffer* buffer = GetLocalBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+
+    Event& e = buffer->events[head % RING_SIZE];
+    e.name = name;
+    e.start = start;
+    e.end = end;
+    e.depth = depth;
+
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+    ThreadBuffer* buffer = GetLocalBuffer();
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffer->name = name;
+}
+
+void Profiler::NewFrame()
+{
+    int64_t now = Now();
+    frameStarts[frameCount % FRAME_HISTORY] = now;
+    frameCount++;
+
+    if (captureLeft == 0) return;
+
+    // capture was requested, it starts on this frame boundary
+    if (captureLeft == captureFrames && captureStart < 0)
+    {
+        captureStart = now;
+        return;
+    }
+
+    if (--captureLeft == 0)
+    {
+        captureStatus = WriteTrace(capturePath, captureStart, now) ? "Saved " + capturePath : "Failed to write " + capturePath;
+        SetEnabled(captureRestoreEnabled);
+    }
+}
+
+void Profiler::CaptureFrames(int frames, const std::string& path)
+{
+    if (frames <= 0 || captureLeft > 0) return;
+
+    captureRestoreEnabled = IsEnabled();
+    SetEnabled(true);
+
+    captureFrames = captureLeft = frames;
+    captureStart = -1;
+    capturePath = path;
+    captureStatus = "Capturing...";
+}
+
+bool Profiler::WriteTrace(const std::string& path, int64_t from, int64_t to)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::PROFILER:: can't open " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    std::vector<Event> events;
+
+    for (unsigned int i = 0; i < buffers.size(); ++i)
+    {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffers[i]->id
+             << ",\"args\":{\"name\":\"" << buffers[i]->name << "\"}}";
+        first = false;
+
+        CollectEvents(*buffers[i], from, to, events);
+        for (unsigned int j = 0; j < events.size(); ++j)
+        {
+            // trace_event timestamps are in microseconds
+            file << ",\n{\"name\":\"" << events[j].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffers[i]->id
+                 << ",\"ts\":" << events[j].start / 1000.0 << ",\"dur\":" << (events[j].end - events[j].start) / 1000.0 << "}";
+        }
+    }
+    file << "\n]}\n";
+
+    return true;
+}
+
+void Profiler::DrawWindow()
+{
+    static bool firstOpen = true;
+    static int framesBack = 1, captureCount = 10;
+    static char tracePath[256] = "trace.json";
+
+    if (firstOpen) {
+        ImGui::SetNextWindowSize(ImVec2(640, 260));
+        firstOpen = false;
+    }
+    ImGui::Begin("CPU Profiler");
+
+    bool enabled = IsEnabled();
+    if (ImGui::Checkbox("Record", &enabled)) SetEnabled(enabled);
+
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80.0f);
+    ImGui::InputInt("frames", &captureCount);
+    captureCount = std::max(1, captureCount);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(160.0f);
+    ImGui::InputText("##tracePath", tracePath, sizeof(tracePath));
+    ImGui::SameLine();
+    if (ImGui::Button("Capture trace")) CaptureFrames(captureCount, tracePath);
+    if (!captureStatus.empty()) ImGui::Text("%s", captureStatus.c_str());
+
+    int available = static_cast<int>(std::min<uint64_t>(frameCount, FRAME_HISTORY)) - 1;
+    if (available < 1)
+    {
+        ImGui::End();
+        return;
+    }
+    ImGui::SliderInt("Frames back", &framesBack, 1, available);
+    framesBack = std::min(framesBack, available);
+
+    // selected frame is between two recorded boundaries
+    int64_t from = frameStarts[(frameCount - framesBack - 1) % FRAME_HISTORY];
+    int64_t to = frameStarts[(frameCount - framesBack) % FRAME_HISTORY];
+    float frameMs = (to - from) / 1000000.0f;
+    ImGui::Text("Frame: %.3f ms", frameMs);
+
+    const float rowHeight = 18.0f, labelWidth = 110.0f;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    float width = ImGui::GetContentRegionAvail().x - labelWidth;
+    if (width < 10.0f) width = 10.0f;
+
+    std::vector<Event> events;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (unsigned int i = 0; i < buffers.size(); ++i)
+    {
+        CollectEvents(*buffers[i], from, to, events);
+
+        int maxDepth = 0;
+        for (unsigned int j = 0; j < events.size(); ++j)
+            maxDepth = std::max(maxDepth, events[j].depth);
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImGui::Text("%s", buffers[i]->name.c_str());
+
+        // one row per nesting level, parents on top like a flame graph
+        for (unsigned int j = 0; j < events.size(); ++j)
+        {
+            const Event& e = events[j];
+            float x0 = origin.x + labelWidth + width * std::max(0.0f, float(e.start - from) / float(to - from));
+            float x1 = origin.x + labelWidth + width * std::min(1.0f, float(e.end - from) / float(to - from));
+            float y0 = origin.y + e.depth * rowHeight;
+            if (x1 - x0 < 1.0f) x1 = x0 + 1.0f;
+
+            ImU32 color = ImColor::HSV((e.depth * 0.13f + 0.55f) - int(e.depth * 0.13f + 0.55f), 0.5f, 0.7f);
+            drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight - 1.0f), color);
+            if (x1 - x0 > 30.0f)
+            {
+                drawList->PushClipRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight), true);
+                drawList->AddText(ImVec2(x0 + 2.0f, y0 + 1.0f), IM_COL32_WHITE, e.name);
+                drawList->PopClipRect();
+            }
+
+            if (ImGui::IsMouseHoveringRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight)))
+                ImGui::SetTooltip("%s\n%.3f ms", e.name, (e.end - e.start) / 1000000.0f);
+        }
+
+        ImGui::SetCursorScreenPos(ImVec2(origin.x, origin.y + (maxDepth + 1) * rowHeight + 4.0f));
+        ImGui::Dummy(ImVec2(labelWidth + width, 0.0f));
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,88 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped CPU timing. Every thread records into its own ring buffer, the main thread reads them
+// for the timeline window and for Chrome trace_event export (chrome://tracing, ui.perfetto.dev).
+// When recording is disabled a scope costs one relaxed atomic load, define MODELVIEWER_NO_PROFILER to compile it out.
+
+#ifndef MODELVIEWER_NO_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+#define PROFILE_FRAME() Profiler::NewFrame()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD(name)
+#define PROFILE_FRAME()
+#endif
+
+class Profiler
+{
+public:
+    // events kept per thread, older ones are overwritten
+    static const int RING_SIZE = 1 << 16;
+    // frame boundaries kept for the timeline
+    static const int FRAME_HISTORY = 256;
+
+    struct Event {
+        const char* name;   // must be a string literal or otherwise outlive the profiler
+        int64_t start;      // ns since profiler start
+        int64_t end;
+        int depth;
+    };
+
+    static void SetEnabled(bool enabled) { enabledFlag.store(enabled, std::memory_order_relaxed); }
+    static bool IsEnabled() { return enabledFlag.load(std::memory_order_relaxed); }
+
+    static void SetThreadName(const std::string& name);
+
+    // marks the beginning of a new frame, call once per frame on the main thread
+    static void NewFrame();
+
+    // records the next `frames` frames and writes them to `path` as Chrome trace_event JSON
+    static void CaptureFrames(int frames, const std::string& path);
+
+    // timeline/flame view of the recorded frames
+    static void DrawWindow();
+
+    static int64_t Now();
+    static void Record(const char* name, int64_t start, int64_t end, int depth);
+    static int& ThreadDepth();
+
+private:
+    static bool WriteTrace(const std::string& path, int64_t from, int64_t to);
+
+    static std::atomic<bool> enabledFlag;
+};
+
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name) : name(name)
+    {
+        if (!Profiler::IsEnabled()) return;
+        depth = Profiler::ThreadDepth()++;
+        start = Profiler::Now();
+    }
+
+    ~ProfileScope()
+    {
+        if (depth < 0) return;
+        Profiler::ThreadDepth()--;
+        Profiler::Record(name, start, Profiler::Now(), depth);
+    }
+
+private:
+    const char* name;
+    int64_t start = 0;
+    int depth = -1;
+};
+
+#endif
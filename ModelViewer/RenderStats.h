@@ -0,0 +1,40 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#define MAX_MESH_LODS 4
+
+// per frame counters shown in the stats window, reset at the start of every frame
+struct RenderStats
+{
+    int drawCalls = 0;
+    long long triangles = 0;
+    int meshesPerLod[MAX_MESH_LODS] = {};
+    long long trianglesPerLod[MAX_MESH_LODS] = {};
+    int clusters = 0;
+    int clustersVisible = 0;
+    int occluders = 0;
+    int occluderTriangles = 0;
+    int occlusionTested = 0;
+    int occlusionCulled = 0;
+    int frustumCulled = 0;
+    int staticChunks = 0;
+    int staticChunksVisible = 0;
+    int skinnedVertices = 0;        // written by transform feedback
+    int geometryPasses = 0;
+    int prepassDrawCalls = 0;       // the depth prepass isn't counted in the numbers above
+    long long prepassTriangles = 0;
+    int animatorsFull = 0;
+    int animatorsReducedRate = 0;
+    int animatorsReducedBones = 0;   // also counted in one of the other groups
+    int animatorsOffscreen = 0;
+    int poseEvaluations = 0;
+    int poseCacheHits = 0;
+    int poseCacheMisses = 0;
+    float poseCacheSavedMs = 0.0f;  // evaluation time of the poses that were copied instead
+
+    void Reset() { *this = RenderStats(); }
+};
+
+inline RenderStats renderStats;
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef RENDER_VIEW_H
+#define RENDER_VIEW_H
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+
+class OcclusionCuller;
+
+// camera state of the frame being drawn, shared by everything that needs to cull or pick LODs
+struct RenderView
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProj;
+    Frustum frustum;
+    glm::vec3 cameraPos;
+    // pixels covered by one world unit at distance 1 from the camera
+    float projScale;
+    // occluders rasterized for this view, null if occlusion culling is off
+    const OcclusionCuller* occlusion = nullptr;
+    // static meshes whose visibleStamp differs are outside the frustum, 0 if the BVH wasn't queried
+    unsigned int visibilityStamp = 0;
+
+    RenderView(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos, float viewportHeight)
+        : view(view), projection(projection), viewProj(projection * view), cameraPos(cameraPos)
+    {
+        frustum = Frustum::FromMatrix(viewProj);
+        projScale = viewportHeight * 0.5f * projection[1][1];
+    }
+
+    // approximate diameter in pixels of a sphere on screen
+    float ProjectedSize(const glm::vec3& center, float radius) const
+    {
+        float distance = glm::max(glm::length(center - cameraPos), 0.001f);
+        return 2.0f * radius * projScale / distance;
+    }
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "SampledClip.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SAMPLED_CLIP_SSE
+#endif
+
+#include <cmath>
+
+void SampledClip::Build(const std::vector<Bone>& bones, float duration, float rate)
+{
+	channelCount = static_cast<int>(bones.size());
+	groupCount = (channelCount + Lanes - 1) / Lanes;
+	samplesPerTick = rate;
+	frameCount = channelCount > 0 && duration > 0.0f ? static_cast<int>(std::ceil(duration * rate)) + 1 : 0;
+	data.assign(static_cast<size_t>(frameCount) * groupCount * Components * Lanes, 0.0f);
+	std::vector<BoneCursor> cursors(channelCount);
+
+	for (int frame = 0; frame < frameCount; ++frame)
+	{
+		float time = glm::min(frame / rate, duration);
+		float* block = &data[static_cast<size_t>(frame) * groupCount * Components * Lanes];
+
+		for (int channel = 0; channel < channelCount; ++channel)
+		{
+			glm::vec3 position = bones[channel].SamplePosition(time, cursors[channel].position);
+			glm::quat rotation = bones[channel].SampleRotation(time, cursors[channel].rotation);
+			glm::vec3 scale = bones[channel].SampleScale(time, cursors[channel].scale);
+
+			// keep neighbouring frames in the same hemisphere so nlerp takes the short way
+			if (frame > 0)
+			{
+				const float* previous = block - groupCount * Components * Lanes + (channel / Lanes) * Components * Lanes + channel % Lanes;
+				float dot = previous[3 * Lanes] * rotation.x + previous[4 * Lanes] * rotation.y + previous[5 * Lanes] * rotation.z + previous[6 * Lanes] * rotation.w;
+				if (dot < 0.0f) rotation = -rotation;
+			}
+
+			float values[Components] = { position.x, position.y, position.z, rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z };
+			float* lane = block + (channel / Lanes) * Components * Lanes + channel % Lanes;
+			for (int c = 0; c < Components; ++c) lane[c * Lanes] = values[c];
+		}
+
+		// unused lanes of the last group get an identity transform
+		for (int channel = channelCount; channel < groupCount * Lanes; ++channel)
+		{
+			float* lane = block + (channel / Lanes) * Components * Lanes + channel % Lanes;
+			lane[6 * Lanes] = lane[7 * Lanes] = lane[8 * Lanes] = lane[9 * Lanes] = 1.0f;
+		}
+	}
+}
+
+void SampledClip::Locate(float animationTime, const float*& a, const float*& b, float& factor) const
+{
+	float position = glm::max(animationTime, 0.0f) * samplesPerTick;
+	int frame = glm::min(static_cast<int>(position), frameCount - 1);
+	int next = glm::min(frame + 1, frameCount - 1);
+	factor = glm::min(position - frame, 1.0f);
+	a = Frame(frame);
+	b = Frame(next);
+}
+
+void SampledClip::Sample(float animationTime, Affine* locals, int limit) const
+{
+	if (frameCount == 0) return;
+	int channels = limit < 0 ? channelCount : glm::min(limit, channelCount);
+	int groups = (channels + Lanes - 1) / Lanes;
+
+	const float* a;
+	const float* b;
+	float factor;
+	Locate(animationTime, a, b, factor);
+#ifndef SAMPLED_CLIP_SSE
+	float m[12][Lanes];
+#endif
+
+	for (int group = 0; group < groups; ++group, a += Components * Lanes, b += Components * Lanes)
+	{
+#ifdef SAMPLED_CLIP_SSE
+		__m128 t = _mm_set1_ps(factor);
+		__m128 v[Components];
+		for (int c = 0; c < Components; ++c)
+		{
+			__m128 va = _mm_loadu_ps(a + c * Lanes);
+			__m128 vb = _mm_loadu_ps(b + c * Lanes);
+			v[c] = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), t));
+		}
+
+		// nlerp, frames were sign aligned when the clip was built
+		__m128 length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[3], v[3]), _mm_mul_ps(v[4], v[4])),
+			_mm_add_ps(_mm_mul_ps(v[5], v[5]), _mm_mul_ps(v[6], v[6])));
+		__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length));
+		__m128 x = _mm_mul_ps(v[3], inverse), y = _mm_mul_ps(v[4], inverse), z = _mm_mul_ps(v[5], inverse), w = _mm_mul_ps(v[6], inverse);
+
+		__m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		// rotation columns scaled by the scale channels
+		__m128 m0 = _mm_mul_ps(v[7], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+		__m128 m1 = _mm_mul_ps(v[7], _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+		__m128 m2 = _mm_mul_ps(v[7], _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+		__m128 m3 = _mm_mul_ps(v[8], _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+		__m128 m4 = _mm_mul_ps(v[8], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+		__m128 m5 = _mm_mul_ps(v[8], _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+		__m128 m6 = _mm_mul_ps(v[9], _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+		__m128 m7 = _mm_mul_ps(v[9], _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+		__m128 m8 = _mm_mul_ps(v[9], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+
+		// m0..m2, m3..m5, m6..m8 are the columns and v[0..2] the translation of 4 channels, transposing
+		// (m0 m3 m6 translation x) gives the first row of every channel
+		__m128 rows[3][Lanes] = { { m0, m3, m6, v[0] }, { m1, m4, m7, v[1] }, { m2, m5, m8, v[2] } };
+		for (int r = 0; r < 3; ++r) _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+
+		int lanes = glm::min(Lanes, channels - group * Lanes);
+		for (int l = 0; l < lanes; ++l)
+		{
+			Affine& local = locals[group * Lanes + l];
+			for (int r = 0; r < 3; ++r) _mm_storeu_ps(&local.rows[r].x, rows[r][l]);
+		}
+#else
+		for (int l = 0; l < Lanes; ++l)
+		{
+			float v[Components];
+			for (int c = 0; c < Components; ++c) v[c] = a[c * Lanes + l] + (b[c * Lanes + l] - a[c * Lanes + l]) * factor;
+
+			float inverse = 1.0f / std::sqrt(v[3] * v[3] + v[4] * v[4] + v[5] * v[5] + v[6] * v[6]);
+			float x = v[3] * inverse, y = v[4] * inverse, z = v[5] * inverse, w = v[6] * inverse;
+
+			m[0][l] = v[7] * (1.0f - 2.0f * (y * y + z * z));
+			m[1][l] = v[7] * 2.0f * (x * y + w * z);
+			m[2][l] = v[7] * 2.0f * (x * z - w * y);
+			m[3][l] = v[8] * 2.0f * (x * y - w * z);
+			m[4][l] = v[8] * (1.0f - 2.0f * (x * x + z * z));
+			m[5][l] = v[8] * 2.0f * (y * z + w * x);
+			m[6][l] = v[9] * 2.0f * (x * z + w * y);
+			m[7][l] = v[9] * 2.0f * (y * z - w * x);
+			m[8][l] = v[9] * (1.0f - 2.0f * (x * x + y * y));
+			m[9][l] = v[0];
+			m[10][l] = v[1];
+			m[11][l] = v[2];
+		}
+
+		int lanes = glm::min(Lanes, channels - group * Lanes);
+		for (int l = 0; l < lanes; ++l)
+		{
+			Affine& local = locals[group * Lanes + l];
+			local.rows[0] = glm::vec4(m[0][l], m[3][l], m[6][l], m[9][l]);
+			local.rows[1] = glm::vec4(m[1][l], m[4][l], m[7][l], m[10][l]);
+			local.rows[2] = glm::vec4(m[2][l], m[5][l], m[8][l], m[11][l]);
+		}
+#endif
+	}
+}
+
+void SampledClip::Sample(float animationTime, const int* channelNodes, Pose& pose) const
+{
+	if (frameCount == 0) return;
+
+	const float* a;
+	const float* b;
+	float factor;
+	Locate(animationTime, a, b, factor);
+	alignas(16) float v[Components][Lanes];
+
+	for (int group = 0; group < groupCount; ++group, a += Components * Lanes, b += Components * Lanes)
+	{
+#ifdef SAMPLED_CLIP_SSE
+		__m128 t = _mm_set1_ps(factor);
+		for (int c = 0; c < Components; ++c)
+		{
+			__m128 va = _mm_loadu_ps(a + c * Lanes);
+			_mm_store_ps(v[c], _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + c * Lanes), va), t)));
+		}
+#else
+		for (int c = 0; c < Components; ++c)
+		{
+			for (int l = 0; l < Lanes; ++l) v[c][l] = a[c * Lanes + l] + (b[c * Lanes + l] - a[c * Lanes + l]) * factor;
+		}
+#endif
+
+		int lanes = glm::min(Lanes, channelCount - group * Lanes);
+		for (int l = 0; l < lanes; ++l)
+		{
+			int node = channelNodes[group * Lanes + l];
+			if (node < 0) continue;
+
+			float inverse = 1.0f / std::sqrt(v[3][l] * v[3][l] + v[4][l] * v[4][l] + v[5][l] * v[5][l] + v[6][l] * v[6][l]);
+			pose.positions[node] = glm::vec3(v[0][l], v[1][l], v[2][l]);
+			pose.rotations[node] = glm::quat(v[6][l] * inverse, v[3][l] * inverse, v[4][l] * inverse, v[5][l] * inverse);
+			pose.scales[node] = glm::vec3(v[7][l], v[8][l], v[9][l]);
+		}
+	}
+}
+
+void SampledClip::Clear()
+{
+	std::vector<float>().swap(data);
+	channelCount = 0;
+	groupCount = 0;
+	frameCount = 0;
+	samplesPerTick = 0.0f;
+}
@@ -0,0 +1,51 @@
+#ifndef SAMPLED_CLIP_H
+#define SAMPLED_CLIP_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Bone.h"
+#include "Pose.h"
+
+// All tracks of a clip resampled at a fixed rate and stored as structure of arrays: for every frame, groups of 4
+// channels with each component (translation xyz, rotation xyzw, scale xyz) in its own lane. Sampling lerps 4
+// channels per SSE instruction, nlerps the rotations and writes the local affine TRS matrices directly.
+class SampledClip
+{
+public:
+	static const int Lanes = 4;
+	static const int Components = 10;
+
+	// samples every bone at rate samples per tick from 0 to duration (in ticks), the last frame lands on duration
+	void Build(const std::vector<Bone>& bones, float duration, float rate);
+
+	// local transforms of the first limit channels (all if -1) at animationTime, the rest of locals is left alone.
+	// locals must hold GetChannelCount() matrices
+	void Sample(float animationTime, Affine* locals, int limit = -1) const;
+
+	// the same as translation, rotation and scale for blending, channel c goes to node channelNodes[c] of pose
+	void Sample(float animationTime, const int* channelNodes, Pose& pose) const;
+
+	// frees the frames, animators fall back to the keys of the bones
+	void Clear();
+
+	bool IsEmpty() const { return frameCount == 0; }
+	int GetChannelCount() const { return channelCount; }
+	int GetFrameCount() const { return frameCount; }
+	size_t GetMemory() const { return data.size() * sizeof(float); }
+
+private:
+	// frame pair and blend factor for a time
+	void Locate(float animationTime, const float*& a, const float*& b, float& factor) const;
+
+	const float* Frame(int frame) const { return &data[static_cast<size_t>(frame) * groupCount * Components * Lanes]; }
+
+	int channelCount = 0;
+	int groupCount = 0;
+	int frameCount = 0;
+	float samplesPerTick = 0.0f;
+	std::vector<float> data;
+};
+
+#endif
@@ -0,0 +1,400 @@
+#include "SceneBVH.h"
+#include "Model.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    const int SAH_BINS = 12;
+    const int MAX_LEAF_ITEMS = 4;
+
+    float SurfaceArea(const AABB& box)
+    {
+        if (!box.IsValid()) return 0.0f;
+        glm::vec3 e = box.Extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // distance along the ray to the box, FLT_MAX if it's missed
+    float RayBox(const AABB& box, const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance)
+    {
+        glm::vec3 t0 = (box.min - origin) * invDirection;
+        glm::vec3 t1 = (box.max - origin) * invDirection;
+        glm::vec3 tMin = glm::min(t0, t1), tMax = glm::max(t0, t1);
+        float enter = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0f));
+        float exit = glm::min(glm::min(tMax.x, tMax.y), glm::min(tMax.z, maxDistance));
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    float PointBoxDistance(const AABB& box, const glm::vec3& point)
+    {
+        glm::vec3 d = glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f));
+        return glm::length(d);
+    }
+}
+
+void SceneBVH::AddModel(std::vector<Item>& items, Model* model, const glm::mat4& matrix)
+{
+    for (unsigned int i = 0; i < model->meshes.size(); ++i)
+    {
+        if (!model->meshes[i].bounds.IsValid()) continue;
+
+        Item item;
+        item.model = model;
+        item.mesh = i;
+        item.bounds = model->meshes[i].bounds.Transformed(matrix);
+        item.matrix = matrix;
+        items.push_back(item);
+    }
+}
+
+void SceneBVH::Rebuild(const std::vector<Item>& newItems)
+{
+    // an older job that is still running finishes on its own and is dropped
+    job = std::make_shared<BuildJob>();
+    job->items = newItems;
+    pending = true;
+
+    std::shared_ptr<BuildJob> buildJob = job;
+    std::thread([buildJob]()
+    {
+        PROFILE_THREAD("BVH build");
+        Build(*buildJob);
+        buildJob->done.store(true, std::memory_order_release);
+    }).detach();
+}
+
+bool SceneBVH::Update()
+{
+    if (!pending || !job->done.load(std::memory_order_acquire)) return false;
+
+    items.swap(job->items);
+    nodes.swap(job->nodes);
+    itemOrder.swap(job->itemOrder);
+    buildTime = job->buildTime;
+    job.reset();
+    pending = false;
+
+    itemLeaf.assign(items.size(), -1);
+    for (unsigned int i = 0; i < nodes.size(); ++i)
+    {
+        for (int j = nodes[i].first; j < nodes[i].first + nodes[i].count; ++j)
+            itemLeaf[itemOrder[j]] = i;
+    }
+    return true;
+}
+
+void SceneBVH::Build(BuildJob& job)
+{
+    PROFILE_SCOPE("SceneBVH::Build");
+    auto start = std::chrono::steady_clock::now();
+
+    job.itemOrder.resize(job.items.size());
+    for (unsigned int i = 0; i < job.items.size(); ++i) job.itemOrder[i] = i;
+    job.nodes.clear();
+    job.nodes.reserve(job.items.size() * 2);
+
+    if (!job.items.empty()) BuildNode(job, 0, static_cast<int>(job.items.size()), -1);
+
+    job.buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int SceneBVH::BuildNode(BuildJob& job, int first, int count, int parent)
+{
+    int index = static_cast<int>(job.nodes.size());
+    job.nodes.push_back(Node());
+    job.nodes[index].parent = parent;
+
+    AABB bounds, centroids;
+    for (int i = first; i < first + count; ++i)
+    {
+        const AABB& box = job.items[job.itemOrder[i]].bounds;
+        bounds.Expand(box);
+        centroids.Expand(box.Center());
+    }
+    job.nodes[index].bounds = bounds;
+
+    auto makeLeaf = [&]()
+    {
+        job.nodes[index].first = first;
+        job.nodes[index].count = count;
+        return index;
+    };
+    if (count <= 2) return makeLeaf();
+
+    // split along the axis where the centroids spread the most
+    glm::vec3 extent = centroids.Extent();
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    // all centroids at the same spot, nothing to split
+    if (extent[axis] <= 0.0f) return makeLeaf();
+
+    // binned surface area heuristic
+    AABB binBounds[SAH_BINS];
+    int binCount[SAH_BINS] = {};
+    float scale = SAH_BINS / extent[axis];
+    auto binOf = [&](int item)
+    {
+        int bin = static_cast<int>((job.items[item].bounds.Center()[axis] - centroids.min[axis]) * scale);
+        return std::min(bin, SAH_BINS - 1);
+    };
+    for (int i = first; i < first + count; ++i)
+    {
+        int bin = binOf(job.itemOrder[i]);
+        binCount[bin]++;
+        binBounds[bin].Expand(job.items[job.itemOrder[i]].bounds);
+    }
+
+    float leftArea[SAH_BINS], rightArea[SAH_BINS];
+    int leftCount[SAH_BINS], rightCount[SAH_BINS];
+    AABB accumulated;
+    int accumulatedCount = 0;
+    for (int i = 0; i < SAH_BINS; ++i)
+    {
+        accumulated.Expand(binBounds[i]);
+        accumulatedCount += binCount[i];
+        leftArea[i] = SurfaceArea(accumulated);
+        leftCount[i] = accumulatedCount;
+    }
+    accumulated = AABB();
+    accumulatedCount = 0;
+    for (int i = SAH_BINS - 1; i > 0; --i)
+    {
+        accumulated.Expand(binBounds[i]);
+        accumulatedCount += binCount[i];
+        rightArea[i] = SurfaceArea(accumulated);
+        rightCount[i] = accumulatedCount;
+    }
+
+    int bestSplit = -1;
+    float bestCost = FLT_MAX;
+    for (int i = 0; i < SAH_BINS - 1; ++i)
+    {
+        if (leftCount[i] == 0 || rightCount[i + 1] == 0) continue;
+        float cost = leftArea[i] * leftCount[i] + rightArea[i + 1] * rightCount[i + 1];
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestSplit = i;
+        }
+    }
+
+    float leafCost = SurfaceArea(bounds) * count;
+    if (bestSplit < 0 || (bestCost >= leafCost && count <= MAX_LEAF_ITEMS)) return makeLeaf();
+
+    int* middle = std::partition(job.itemOrder.data() + first, job.itemOrder.data() + first + count,
+        [&](int item) { return binOf(item) <= bestSplit; });
+    int leftItems = static_cast<int>(middle - (job.itemOrder.data() + first));
+
+    int left = BuildNode(job, first, leftItems, index);
+    int right = BuildNode(job, first + leftItems, count - leftItems, index);
+    job.nodes[index].left = left;
+    job.nodes[index].right = right;
+    return index;
+}
+
+void SceneBVH::UpdateModel(Model* model, const glm::mat4& matrix)
+{
+    if (nodes.empty()) return;
+
+    // children always come after their parent, so walking dirty nodes backwards refits bottom up
+    static std::vector<char> dirty;
+    dirty.assign(nodes.size(), 0);
+    int lowest = static_cast<int>(nodes.size());
+
+    for (unsigned int i = 0; i < items.size(); ++i)
+    {
+        if (items[i].model != model) continue;
+
+        items[i].matrix = matrix;
+        items[i].bounds = model->meshes[items[i].mesh].bounds.Transformed(matrix);
+        for (int node = itemLeaf[i]; node >= 0 && !dirty[node]; node = nodes[node].parent)
+        {
+            dirty[node] = 1;
+            lowest = std::min(lowest, node);
+        }
+    }
+
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= lowest; --i)
+    {
+        if (!dirty[i]) continue;
+
+        Node& node = nodes[i];
+        node.bounds = AABB();
+        if (node.left < 0)
+        {
+            for (int j = node.first; j < node.first + node.count; ++j)
+                node.bounds.Expand(items[itemOrder[j]].bounds);
+        }
+        else
+        {
+            node.bounds.Expand(nodes[node.left].bounds);
+            node.bounds.Expand(nodes[node.right].bounds);
+        }
+        counters.refitNodes++;
+    }
+}
+
+void SceneBVH::QueryFrustum(const Frustum& frustum, std::vector<int>& result)
+{
+    result.clear();
+    counters.frustumQueries++;
+    if (nodes.empty()) return;
+
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        counters.nodesVisited++;
+
+        if (!frustum.IntersectsAABB(node.bounds)) continue;
+
+        if (node.left < 0)
+        {
+            for (int j = node.first; j < node.first + node.count; ++j)
+            {
+                if (node.count == 1 || frustum.IntersectsAABB(items[itemOrder[j]].bounds))
+                    result.push_back(itemOrder[j]);
+            }
+        }
+        else
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+bool SceneBVH::RayTriangles(const Item& item, const glm::vec3& origin, const glm::vec3& direction, float& closest)
+{
+    // the ray parameter is the same in model space, the transform is affine
+    glm::mat4 inverse = glm::inverse(item.matrix);
+    glm::vec3 o = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+    glm::vec3 d = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+
+    const Mesh& mesh = item.model->meshes[item.mesh];
+    bool hit = false;
+    for (unsigned int i = 0; i + 2 < mesh.lods[0].indexCount; i += 3)
+    {
+        const glm::vec3& p0 = mesh.vertices[mesh.indices[i]].Position;
+        const glm::vec3& p1 = mesh.vertices[mesh.indices[i + 1]].Position;
+        const glm::vec3& p2 = mesh.vertices[mesh.indices[i + 2]].Position;
+
+        // Moller-Trumbore
+        glm::vec3 e1 = p1 - p0, e2 = p2 - p0;
+        glm::vec3 p = glm::cross(d, e2);
+        float det = glm::dot(e1, p);
+        if (glm::abs(det) < 1e-12f) continue;
+
+        float invDet = 1.0f / det;
+        glm::vec3 s = o - p0;
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f) continue;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(d, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f) continue;
+
+        float t = glm::dot(e2, q) * invDet;
+        if (t > 0.0f && t < closest)
+        {
+            closest = t;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+int SceneBVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, float* distance)
+{
+    counters.rayQueries++;
+    if (nodes.empty()) return -1;
+
+    glm::vec3 invDirection = 1.0f / direction;
+    float closest = FLT_MAX;
+    int hitItem = -1;
+
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        counters.nodesVisited++;
+
+        if (RayBox(node.bounds, origin, invDirection, closest) == FLT_MAX) continue;
+
+        if (node.left < 0)
+        {
+            for (int j = node.first; j < node.first + node.count; ++j)
+            {
+                const Item& item = items[itemOrder[j]];
+                if (RayBox(item.bounds, origin, invDirection, closest) == FLT_MAX) continue;
+                if (RayTriangles(item, origin, direction, closest)) hitItem = itemOrder[j];
+            }
+        }
+        else
+        {
+            // nearer child is popped first, so farther subtrees get pruned by the closer hit
+            float leftDistance = RayBox(nodes[node.left].bounds, origin, invDirection, closest);
+            float rightDistance = RayBox(nodes[node.right].bounds, origin, invDirection, closest);
+            if (leftDistance < rightDistance)
+            {
+                stack.push_back(node.right);
+                stack.push_back(node.left);
+            }
+            else
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    if (distance) *distance = closest;
+    return hitItem;
+}
+
+int SceneBVH::Nearest(const glm::vec3& point)
+{
+    counters.nearestQueries++;
+    if (nodes.empty()) return -1;
+
+    float best = FLT_MAX;
+    int bestItem = -1;
+
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        counters.nodesVisited++;
+
+        if (PointBoxDistance(node.bounds, point) >= best) continue;
+
+        if (node.left < 0)
+        {
+            for (int j = node.first; j < node.first + node.count; ++j)
+            {
+                float d = PointBoxDistance(items[itemOrder[j]].bounds, point);
+                if (d < best)
+                {
+                    best = d;
+                    bestItem = itemOrder[j];
+                }
+            }
+        }
+        else
+        {
+            float leftDistance = PointBoxDistance(nodes[node.left].bounds, point);
+            float rightDistance = PointBoxDistance(nodes[node.right].bounds, point);
+            stack.push_back(leftDistance < rightDistance ? node.right : node.left);
+            stack.push_back(leftDistance < rightDistance ? node.left : node.right);
+        }
+    }
+    return bestItem;
+}
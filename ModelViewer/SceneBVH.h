@@ -0,0 +1,98 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "Bounds.h"
+
+class Model;
+
+// Bounding volume hierarchy over the world space bounds of every mesh of every loaded model.
+// It's built with binned SAH on a background thread, transform changes are refitted in place.
+class SceneBVH
+{
+public:
+    struct Item {
+        Model* model;
+        int mesh;
+        AABB bounds;        // world space
+        glm::mat4 matrix;   // model matrix, for ray tests against triangles
+    };
+
+    struct Counters {
+        int frustumQueries = 0, rayQueries = 0, nearestQueries = 0;
+        int nodesVisited = 0;
+        int refitNodes = 0;
+    };
+
+    // appends items for every mesh of the model
+    static void AddModel(std::vector<Item>& items, Model* model, const glm::mat4& matrix);
+
+    // starts building a new tree on a background thread, the current one stays valid for queries until it's done
+    void Rebuild(const std::vector<Item>& items);
+
+    // picks up a finished background build, call once per frame on the main thread.
+    // Returns true when a new tree was taken, its bounds are from the time Rebuild was called.
+    bool Update();
+
+    // false while a rebuild for the latest scene is still running, queries then see the previous scene
+    bool IsCurrent() { return !pending; }
+
+    // new transform of a model, bounds of its meshes and their ancestors are refitted
+    void UpdateModel(Model* model, const glm::mat4& matrix);
+
+    // items whose bounds intersect the frustum
+    void QueryFrustum(const Frustum& frustum, std::vector<int>& result);
+
+    // closest item hit by the ray, triangles of the mesh are tested. Returns -1 if nothing is hit
+    int Raycast(const glm::vec3& origin, const glm::vec3& direction, float* distance = nullptr);
+
+    // item with the bounds closest to the point, -1 if the tree is empty
+    int Nearest(const glm::vec3& point);
+
+    const Item& GetItem(int index) { return items[index]; }
+    int GetItemCount() { return static_cast<int>(items.size()); }
+    int GetNodeCount() { return static_cast<int>(nodes.size()); }
+    float GetBuildTime() { return buildTime; }
+
+    Counters& GetCounters() { return counters; }
+    void ResetCounters() { counters = Counters(); }
+
+private:
+    struct Node {
+        AABB bounds;
+        int left = -1, right = -1;  // children, -1 for leaves
+        int first = 0, count = 0;   // range in itemOrder for leaves
+        int parent = -1;
+    };
+
+    struct BuildJob {
+        std::vector<Item> items;
+        std::vector<Node> nodes;
+        std::vector<int> itemOrder;
+        float buildTime = 0.0f;
+        std::atomic<bool> done{ false };
+    };
+
+    static void Build(BuildJob& job);
+    static int BuildNode(BuildJob& job, int first, int count, int parent);
+
+    bool RayTriangles(const Item& item, const glm::vec3& origin, const glm::vec3& direction, float& closest);
+
+    std::vector<Item> items;
+    std::vector<Node> nodes;
+    std::vector<int> itemOrder;
+    std::vector<int> itemLeaf;      // leaf node of every item, for refits
+    std::vector<int> stack;
+
+    std::shared_ptr<BuildJob> job;
+    bool pending = false;
+    float buildTime = 0.0f;
+    Counters counters;
+};
+
+#endif
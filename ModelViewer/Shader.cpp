@@ -1,7 +1,69 @@
 #include "Shader.h"
+#include "Profiler.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+// linked programs are stored here, relative to the working directory
+#define SHADER_CACHE_DIR "shader_cache"
+
+namespace
 {
+    const unsigned int PROGRAM_BINARY_MAGIC = 0x4253564d; // "MVSB"
+
+    struct ProgramBinaryHeader {
+        unsigned int magic = PROGRAM_BINARY_MAGIC;
+        GLenum format = 0;
+        unsigned int length = 0;
+        float compileTime = 0.0f;   // ms the program took to compile and link, to report the time saved
+    };
+
+    // FNV-1a
+    unsigned long long hashString(const std::string& str)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        for (unsigned char c : str)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string driverString()
+    {
+        auto get = [](GLenum name) { const GLubyte* str = glGetString(name); return str ? std::string(reinterpret_cast<const char*>(str)) : std::string(); };
+        return get(GL_VENDOR) + '\0' + get(GL_RENDERER) + '\0' + get(GL_VERSION);
+    }
+
+    // the entry points are GL 4.1, a strict 3.3 context leaves them NULL
+    bool programBinarySupported()
+    {
+        if (!GLAD_GL_VERSION_4_1 || !glProgramParameteri || !glProgramBinary || !glGetProgramBinary) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // defines go right after the #version line, it has to stay first
+    std::string insertDefines(const std::string& code, const std::string& defines)
+    {
+        if (defines.empty()) return code;
+        size_t line = code.find("#version");
+        if (line == std::string::npos) return defines + "\n" + code;
+        size_t end = code.find('\n', line);
+        if (end == std::string::npos) return code + "\n" + defines + "\n";
+        end++;
+        return code.substr(0, end) + defines + "\n" + code.substr(end);
+    }
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines, const std::vector<std::string>& feedbackVaryings)
+{
+    PROFILE_SCOPE("Shader::Shader");
+
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
     std::string fragmentCode;
@@ -14,14 +76,17 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     {
         // open files
         vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
         std::stringstream vShaderStream, fShaderStream;
         // read file's buffer contents into streams
         vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
         vShaderFile.close();
-        fShaderFile.close();
+        // no fragment stage for transform feedback programs
+        if (fragmentPath)
+        {
+            fShaderFile.open(fragmentPath);
+            fShaderStream << fShaderFile.rdbuf();
+            fShaderFile.close();
+        }
         // convert stream into string
         vertexCode = vShaderStream.str();
         fragmentCode = fShaderStream.str();
@@ -30,29 +95,135 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
     }
+
+    vertexCode = insertDefines(vertexCode, defines);
+    if (fragmentPath) fragmentCode = insertDefines(fragmentCode, defines);
+
+    // 2. restore the program from the cache if this driver linked the same sources before
+    bool cacheSupported = programBinarySupported();
+    std::string cachePath;
+    if (cacheSupported)
+    {
+        std::string key = vertexCode + '\0' + fragmentCode + '\0' + defines + '\0' + driverString();
+        for (unsigned int i = 0; i < feedbackVaryings.size(); ++i) key += '\0' + feedbackVaryings[i];
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hashString(key)));
+        cachePath = std::string(SHADER_CACHE_DIR) + "/" + name;
+
+        float compileTime = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        if (loadProgramBinary(cachePath, compileTime))
+        {
+            float loadTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "SHADER::CACHE: " << vertexPath << (fragmentPath ? std::string(" + ") + fragmentPath : "") << " restored in " << loadTime << " ms, "
+                      << compileTime - loadTime << " ms saved" << std::endl;
+            return;
+        }
+    }
+
+    // 3. compile shaders
+    auto start = std::chrono::steady_clock::now();
+    bool linked = compileProgram(vertexCode, fragmentCode, feedbackVaryings);
+    float compileTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (cacheSupported && linked) saveProgramBinary(cachePath, compileTime);
+}
+
+bool Shader::compileProgram(const std::string& vertexCode, const std::string& fragmentCode, const std::vector<std::string>& feedbackVaryings)
+{
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
-    // 2. compile shaders
-    unsigned int vertex, fragment;
+    unsigned int vertex, fragment = 0;
     // vertex shader
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
     checkCompileErrors(vertex, "VERTEX");
     // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    if (!fragmentCode.empty())
+    {
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+    }
     // shader Program
     ID = glCreateProgram();
+    if (programBinarySupported()) glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
+    if (fragment) glAttachShader(ID, fragment);
+    // captured outputs are written interleaved into one buffer
+    if (!feedbackVaryings.empty())
+    {
+        std::vector<const char*> names;
+        for (unsigned int i = 0; i < feedbackVaryings.size(); ++i) names.push_back(feedbackVaryings[i].c_str());
+        glTransformFeedbackVaryings(ID, static_cast<GLsizei>(names.size()), names.data(), GL_INTERLEAVED_ATTRIBS);
+    }
     glLinkProgram(ID);
     checkCompileErrors(ID, "PROGRAM");
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    if (fragment) glDeleteShader(fragment);
+
+    GLint success;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    return success != 0;
+}
+
+bool Shader::loadProgramBinary(const std::string& path, float& compileTime)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    ProgramBinaryHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != PROGRAM_BINARY_MAGIC) return false;
+
+    std::vector<char> binary(header.length);
+    file.read(binary.data(), header.length);
+    if (!file) return false;
+
+    ID = glCreateProgram();
+    glProgramBinary(ID, header.format, binary.data(), header.length);
+
+    // drivers reject binaries after updates or for other hardware, the caller compiles from source then
+    GLint success;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        std::cout << "SHADER::CACHE: binary " << path << " was rejected by the driver, compiling from source" << std::endl;
+        glDeleteProgram(ID);
+        ID = 0;
+        return false;
+    }
+
+    compileTime = header.compileTime;
+    return true;
+}
+
+void Shader::saveProgramBinary(const std::string& path, float compileTime)
+{
+    GLint length = 0;
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    ProgramBinaryHeader header;
+    glGetProgramBinary(ID, length, NULL, &header.format, binary.data());
+    header.length = static_cast<unsigned int>(length);
+    header.compileTime = compileTime;
+
+    std::error_code error;
+    std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::SHADER::CACHE_NOT_WRITTEN: " << path << std::endl;
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), length);
 }
 
 void Shader::use() const
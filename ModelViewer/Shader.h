@@ -8,14 +8,17 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, defines are inserted after the #version line of both stages.
+    // Linked programs are cached in shader_cache/ and restored on later runs if the driver accepts them.
+    // Without a fragment path and with feedback varyings it's a vertex only program for transform feedback
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath);
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "", const std::vector<std::string>& feedbackVaryings = {});
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const;
@@ -46,5 +49,10 @@ private:
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type);
+    // compiles and links from source, returns false if anything failed
+    bool compileProgram(const std::string& vertexCode, const std::string& fragmentCode, const std::vector<std::string>& feedbackVaryings);
+    // program binary cache, the file name is a hash of the sources, defines and driver strings
+    bool loadProgramBinary(const std::string& path, float& compileTime);
+    void saveProgramBinary(const std::string& path, float compileTime);
 };
 #endif
\ No newline at end of file
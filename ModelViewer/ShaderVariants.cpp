@@ -0,0 +1,36 @@
+#include "ShaderVariants.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+Shader& ShaderVariants::Get(const std::string& defines)
+{
+    auto requested = requests.find(defines);
+    if (requested != requests.end()) return *requested->second;
+
+    // "SKINNED BONE_INFLUENCES=2" -> "#define BONE_INFLUENCES 2\n#define SKINNED"
+    std::vector<std::string> names;
+    std::stringstream stream(defines);
+    std::string name;
+    while (stream >> name) names.push_back(name);
+    std::sort(names.begin(), names.end());
+
+    std::string lines;
+    for (unsigned int i = 0; i < names.size(); ++i)
+    {
+        size_t equals = names[i].find('=');
+        if (equals != std::string::npos) names[i][equals] = ' ';
+        lines += (i ? "\n#define " : "#define ") + names[i];
+    }
+
+    std::unique_ptr<Shader>& variant = variants[lines];
+    if (!variant)
+    {
+        PROFILE_SCOPE("ShaderVariants::Compile");
+        variant.reset(new Shader(vertexPath.c_str(), fragmentPath.empty() ? nullptr : fragmentPath.c_str(), lines, feedbackVaryings));
+    }
+    requests[defines] = variant.get();
+    return *variant;
+}
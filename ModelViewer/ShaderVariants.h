@@ -0,0 +1,33 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Shader.h"
+
+// Permutations of one vertex/fragment pair, compiled on first use from a set of #defines and kept for later frames.
+// Every permutation also goes through the program binary cache of Shader.
+class ShaderVariants
+{
+public:
+    // fragmentPath can be null for transform feedback programs, see Shader
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& feedbackVaryings = {})
+        : vertexPath(vertexPath), fragmentPath(fragmentPath ? fragmentPath : ""), feedbackVaryings(feedbackVaryings) {}
+
+    // defines as "NAME" or "NAME=VALUE" separated by spaces, the order doesn't matter
+    Shader& Get(const std::string& defines);
+
+    int GetVariantCount() const { return static_cast<int>(variants.size()); }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> feedbackVaryings;
+    // keyed by the sorted #define lines
+    std::map<std::string, std::unique_ptr<Shader>> variants;
+    // requested strings as they were passed to Get, so the per frame lookup skips the parsing
+    std::map<std::string, Shader*> requests;
+};
+
+#endif
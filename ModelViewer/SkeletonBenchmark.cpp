@@ -0,0 +1,262 @@
+#include "SkeletonBenchmark.h"
+
+#include "Animation.h"
+#include "Animator.h"
+#include "JobSystem.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+
+namespace
+{
+	aiNodeAnim* MakeChannel(const std::string& name, std::mt19937& random, int keyCount)
+	{
+		std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+		aiNodeAnim* channel = new aiNodeAnim();
+		channel->mNodeName = aiString(name);
+		channel->mNumPositionKeys = keyCount;
+		channel->mPositionKeys = new aiVectorKey[keyCount];
+		channel->mNumRotationKeys = keyCount;
+		channel->mRotationKeys = new aiQuatKey[keyCount];
+		channel->mNumScalingKeys = 1;
+		channel->mScalingKeys = new aiVectorKey[1];
+
+		// like baked motion capture: joints turn a little between keys, bone lengths never change
+		aiVector3D axis = aiVector3D(value(random), value(random), value(random)).Normalize();
+		aiVector3D position = aiVector3D(value(random), value(random), value(random)) * 0.1f;
+		float angle = value(random) * 3.14f;
+		for (int k = 0; k < keyCount; ++k)
+		{
+			channel->mPositionKeys[k] = aiVectorKey(k, position);
+			angle += value(random) * 0.2f;
+			channel->mRotationKeys[k] = aiQuatKey(k, aiQuaternion(axis, angle));
+		}
+		channel->mScalingKeys[0] = aiVectorKey(0, aiVector3D(1.0f));
+		return channel;
+	}
+
+	float MaxDifference(const std::vector<Affine>& a, const std::vector<Affine>& b)
+	{
+		float maxDifference = 0.0f;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			for (int r = 0; r < 3; ++r)
+			{
+				glm::vec4 difference = glm::abs(a[i].rows[r] - b[i].rows[r]);
+				maxDifference = glm::max(maxDifference, glm::max(glm::max(difference.x, difference.y), glm::max(difference.z, difference.w)));
+			}
+		}
+		return maxDifference;
+	}
+}
+
+int RunSkeletonBenchmark(int nodeCount, int iterations)
+{
+	const int keyCount = 60;
+	std::mt19937 random(7);
+
+	// mostly long chains like spines and fingers, every tenth node is a helper without keys or vertices
+	std::vector<aiNode*> nodes;
+	nodes.push_back(new aiNode("root"));
+	std::vector<aiNodeAnim*> channels;
+	std::map<std::string, BoneInfo> boneInfoMap;
+	int boneIds = 0;
+
+	for (int i = 1; i <= nodeCount; ++i)
+	{
+		std::string name = "bone_" + std::to_string(i);
+		aiNode* node = new aiNode(name);
+		node->mTransformation = aiMatrix4x4(aiVector3D(1.0f), aiQuaternion(), aiVector3D(0.0f, 0.1f, 0.0f));
+
+		int parent = random() % 4 != 0 ? i - 1 : static_cast<int>(random() % i);
+		nodes[parent]->addChildren(1, &node);
+		nodes.push_back(node);
+
+		if (i % 10 == 0) continue;
+		channels.push_back(MakeChannel(name, random, keyCount));
+		boneInfoMap[name].id = boneIds++;
+		boneInfoMap[name].offset = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.1f * i, 0.0f));
+	}
+
+	// what exporters add around a rig: an end site under every leaf joint and a few mesh nodes, none of them
+	// carries keys or vertices and the skeleton prunes them
+	int jointCount = static_cast<int>(nodes.size());
+	for (int i = 1; i < jointCount; ++i)
+	{
+		if (nodes[i]->mNumChildren > 0) continue;
+		aiNode* end = new aiNode(nodes[i]->mName.C_Str() + std::string("_end"));
+		nodes[i]->addChildren(1, &end);
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		aiNode* mesh = new aiNode("mesh_" + std::to_string(i));
+		nodes[0]->addChildren(1, &mesh);
+	}
+
+	aiAnimation clip;
+	clip.mDuration = keyCount - 1;
+	clip.mTicksPerSecond = 30.0;
+	clip.mNumChannels = static_cast<unsigned int>(channels.size());
+	clip.mChannels = new aiNodeAnim*[channels.size()];
+	for (size_t i = 0; i < channels.size(); ++i) clip.mChannels[i] = channels[i];
+
+	Animation animation(&clip, nodes[0], boneInfoMap, boneIds);
+	Animator animator(&animation);
+
+	// a scene full of characters sharing a few clips, half of them interpolate the keys instead of the sampled clip
+	const int characterCount = 64;
+	const int clipCount = 4;
+	std::vector<std::unique_ptr<Animation>> characterClips;
+	std::vector<std::unique_ptr<Animator>> characters;
+	for (int i = 0; i < clipCount; ++i)
+		characterClips.push_back(std::make_unique<Animation>(&clip, nodes[0], boneInfoMap, boneIds));
+	for (int i = 0; i < characterCount; ++i)
+	{
+		characters.push_back(std::make_unique<Animator>(characterClips[i % clipCount].get()));
+		characters.back()->UseSampledClip(i % 2 == 0);
+	}
+	delete nodes[0];
+
+	// all paths sample the same time, between two keys
+	animator.UpdateAnimation(0.71f);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+		animator.CalculateBoneTransform(&animation.GetRootNode(), glm::mat4(1.0f));
+	float recursive = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+	std::vector<Affine> reference = animator.GetFinalBoneMatrices();
+
+	animator.UseSampledClip(false);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+		animator.CalculateBoneTransforms();
+	float flat = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+	float flatDifference = MaxDifference(animator.GetFinalBoneMatrices(), reference);
+
+	animator.UseSampledClip(true);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+		animator.CalculateBoneTransforms();
+	float sampled = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+	float sampledDifference = MaxDifference(animator.GetFinalBoneMatrices(), reference);
+
+	std::cout << "Skeleton: " << animation.GetHierarchyNodeCount() << " nodes, " << animation.GetSkeleton().size() << " after pruning ("
+			  << animation.GetFoldedTransforms().size() << " folded chains), " << boneIds << " bones, " << iterations << " updates" << std::endl;
+	std::cout << "  recursive tree: " << recursive << " us per update" << std::endl;
+	std::cout << "  flat skeleton:  " << flat << " us per update (" << (flat > 0.0f ? recursive / flat : 0.0f) << "x), max difference "
+			  << flatDifference << std::endl;
+	std::cout << "  sampled clip:   " << sampled << " us per update (" << (sampled > 0.0f ? flat / sampled : 0.0f) << "x over flat), max difference "
+			  << sampledDifference << ", " << animation.GetSampledClip().GetFrameCount() << " frames, "
+			  << animation.GetSampledClip().GetMemory() / 1024 << " KB" << std::endl;
+
+	// compressed clips play from the packed keys
+	ClipCompressionReport report = animation.Compress(ClipCompressionSettings());
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+		animator.CalculateBoneTransforms();
+	float compressed = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+	float compressedDifference = MaxDifference(animator.GetFinalBoneMatrices(), reference);
+
+	std::cout << "  compressed:     " << compressed << " us per update from packed keys, max difference " << compressedDifference << ", "
+			  << report.keysBefore << " -> " << report.keysAfter << " keys, " << report.bytesBefore / 1024 << " -> " << report.bytesAfter / 1024
+			  << " KB, max key error " << report.maxPositionError << " / " << report.maxRotationError << " deg" << std::endl;
+
+	// same frames serially and on the job system, the parallel result has to be identical
+	int frames = glm::max(iterations / 10, 1);
+	start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; ++f)
+	{
+		for (int i = 0; i < characterCount; ++i)
+			characters[i]->UpdateAnimation(1.0f / 60.0f + i * 0.001f);
+	}
+	float serial = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	std::vector<std::vector<Affine>> serialResults;
+	for (int i = 0; i < characterCount; ++i) serialResults.push_back(characters[i]->GetFinalBoneMatrices());
+
+	for (int i = 0; i < characterCount; ++i) characters[i]->PlayAnimation(characterClips[i % clipCount].get());
+	start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; ++f)
+	{
+		JobSystem::Get().ParallelFor(characterCount, 1, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+				characters[i]->UpdateAnimation(1.0f / 60.0f + i * 0.001f);
+		});
+	}
+	float parallel = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	bool identical = true;
+	for (int i = 0; i < characterCount; ++i) identical &= characters[i]->GetFinalBoneMatrices() == serialResults[i];
+
+	std::cout << "  " << characterCount << " characters: " << serial << " ms serial, " << parallel << " ms on " << JobSystem::Get().GetThreadCount()
+			  << " threads (" << (parallel > 0.0f ? serial / parallel : 0.0f) << "x), " << (identical ? "identical" : "DIFFERENT") << " results" << std::endl;
+	std::cout << "  memory: " << clipCount << " shared clips " << characterClips[0]->GetMemory() * clipCount / 1024 << " KB, "
+			  << characters[0]->GetMemory() / 1024 << " KB per character" << std::endl;
+
+	// a distant character: every fourth frame is posed, only the upper levels of the skeleton are sampled
+	AnimationLod lod;
+	lod.interval = 4;
+	lod.maxDepth = 4;
+	int evaluations = 0;
+	for (int i = 0; i < characterCount; ++i) characters[i]->PlayAnimation(characterClips[i % clipCount].get());
+	start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; ++f)
+	{
+		for (int i = 0; i < characterCount; ++i)
+			evaluations += characters[i]->UpdateAnimation(1.0f / 60.0f + i * 0.001f, lod);
+	}
+	float reduced = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+	std::cout << "  " << characterCount << " characters at LOD: " << reduced << " ms (" << (reduced > 0.0f ? serial / reduced : 0.0f) << "x), "
+			  << evaluations << " of " << frames * characterCount << " updates posed, " << characterClips[0]->GetChannelCount(lod.maxDepth)
+			  << " of " << characterClips[0]->GetBones().size() << " channels" << std::endl;
+
+	// a crowd in step: characters on the same clip copy the first one's pose from the cache
+	PoseCache cache;
+	for (int i = 0; i < characterCount; ++i) characters[i]->PlayAnimation(characterClips[i % clipCount].get());
+	start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; ++f)
+	{
+		cache.Begin(1.0f / 30.0f);
+		for (int i = 0; i < characterCount; ++i)
+			characters[i]->UpdateAnimation(1.0f / 60.0f, AnimationLod(), &cache);
+	}
+	float shared = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	int lookups = cache.GetHits() + cache.GetMisses();
+
+	std::cout << "  " << characterCount << " characters sharing poses: " << shared << " ms (" << (shared > 0.0f ? serial / shared : 0.0f) << "x), "
+			  << cache.GetHits() << " of " << lookups << " lookups hit, " << cache.GetSavedMilliseconds() << " ms saved in the last frame" << std::endl;
+
+	// blending: the pose path without any weight has to match the matrix path
+	Animator single(characterClips[0].get());
+	single.UpdateAnimation(0.71f);
+	std::vector<Affine> unblended = single.GetFinalBoneMatrices();
+	single.AddLayer(characterClips[1].get(), 0.0f);
+	single.CalculateBoneTransforms();
+	float poseDifference = MaxDifference(single.GetFinalBoneMatrices(), unblended);
+
+	// every character fades into the next clip with an upper body layer on top, ModelViewerTests checks that this doesn't allocate
+	for (int i = 0; i < characterCount; ++i)
+	{
+		characters[i]->PlayAnimation(characterClips[i % clipCount].get());
+		characters[i]->CrossFade(characterClips[(i + 1) % clipCount].get(), 100.0f);
+		characters[i]->AddLayer(characterClips[(i + 2) % clipCount].get(), 0.7f, characterClips[0]->MakeMask("bone_20"));
+		characters[i]->UpdateAnimation(1.0f / 60.0f);
+	}
+	start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; ++f)
+	{
+		for (int i = 0; i < characterCount; ++i)
+			characters[i]->UpdateAnimation(1.0f / 60.0f + i * 0.001f);
+	}
+	float blended = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+	std::cout << "  " << characterCount << " characters blending 3 clips: " << blended << " ms, pose path max difference " << poseDifference << std::endl;
+
+	// the sampled and compressed clips are lossy, only the flat path has to match exactly
+	return flatDifference < 1e-4f && poseDifference < 1e-3f && identical ? 0 : 1;
+}
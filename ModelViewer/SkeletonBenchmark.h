@@ -0,0 +1,10 @@
+#ifndef SKELETON_BENCHMARK_H
+#define SKELETON_BENCHMARK_H
+
+// Builds a synthetic rig of nodeCount nodes below a root, every tenth one a helper without keys, and times the
+// recursive node tree evaluation against the flattened skeleton on the same animator. Prints the time per update
+// and the largest difference between the two results, then times characters at a reduced LOD and blending clips.
+// Returns the process exit code.
+int RunSkeletonBenchmark(int nodeCount = 200, int iterations = 1000);
+
+#endif
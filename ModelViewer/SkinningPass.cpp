@@ -0,0 +1,30 @@
+#include "SkinningPass.h"
+#include "Model.h"
+#include "Profiler.h"
+#include "BonePalette.h"
+
+void SkinningPass::Skin(Model& model, int boneOffset)
+{
+    PROFILE_FUNCTION();
+
+    int influences = model.GetBoneInfluences();
+    if (influences == 0) return;
+
+    Shader& shader = shaders.Get("BONE_INFLUENCES=" + std::to_string(influences));
+    shader.use();
+    shader.setInt("bonePalette", BonePalette::TEXTURE_UNIT);
+    shader.setInt("boneOffset", boneOffset);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    for (unsigned int i = 0; i < model.meshes.size(); i++)
+    {
+        if (model.meshes[i].IsSkinned()) model.meshes[i].Skin();
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void SkinningPass::Release(Model& model)
+{
+    for (unsigned int i = 0; i < model.meshes.size(); i++)
+        model.meshes[i].ReleaseSkinned();
+}
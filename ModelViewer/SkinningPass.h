@@ -0,0 +1,24 @@
+#ifndef SKINNING_PASS_H
+#define SKINNING_PASS_H
+
+#include "ShaderVariants.h"
+
+class Model;
+
+// Skins animated meshes once per frame with transform feedback (skin.vx), so every pass drawing them afterwards
+// uses the static vertex shader instead of skinning the same vertices again.
+class SkinningPass
+{
+public:
+    SkinningPass() : shaders("skin.vx", nullptr, { "skinnedPos", "skinnedNorm" }) {}
+
+    // writes the skinned vertices of every skinned mesh of the model, its bones start at boneOffset in the bone palette
+    void Skin(Model& model, int boneOffset);
+    // the model's meshes go back to skinning in the vertex shader
+    void Release(Model& model);
+
+private:
+    ShaderVariants shaders;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "StaticBatcher.h"
+#include "Model.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    bool SameTextures(const vector<Texture>& a, const vector<Texture>& b)
+    {
+        if (a.size() != b.size()) return false;
+        for (unsigned int i = 0; i < a.size(); ++i)
+        {
+            if (a[i].id != b[i].id || a[i].type != b[i].type) return false;
+        }
+        return true;
+    }
+}
+
+void StaticBatcher::Bake(const std::vector<std::pair<Model*, glm::mat4>>& models)
+{
+    PROFILE_FUNCTION();
+    auto start = std::chrono::steady_clock::now();
+
+    Clear();
+
+    // meshes sharing a texture set end up in the same batch
+    struct Group {
+        vector<Texture> textures;
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+    };
+    vector<Group> groups;
+
+    for (unsigned int m = 0; m < models.size(); ++m)
+    {
+        Model* model = models[m].first;
+        if (model->IsMoveable() || model->IsAnimated()) continue;
+
+        const glm::mat4& matrix = models[m].second;
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(matrix)));
+        bakedModels.push_back(model);
+
+        for (unsigned int i = 0; i < model->meshes.size(); ++i)
+        {
+            const Mesh& mesh = model->meshes[i];
+            if (mesh.vertices.empty()) continue;
+
+            unsigned int g = 0;
+            while (g < groups.size() && !SameTextures(groups[g].textures, mesh.textures)) g++;
+            if (g == groups.size())
+            {
+                groups.push_back(Group());
+                groups[g].textures = mesh.textures;
+            }
+            Group& group = groups[g];
+
+            unsigned int base = static_cast<unsigned int>(group.vertices.size());
+            for (unsigned int v = 0; v < mesh.vertices.size(); ++v)
+            {
+                Vertex vertex = mesh.vertices[v];
+                vertex.Position = glm::vec3(matrix * glm::vec4(vertex.Position, 1.0f));
+                if (glm::length(vertex.Normal) > 0.0f) vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+                vertex.Tangent = glm::mat3(matrix) * vertex.Tangent;
+                vertex.Bitangent = glm::mat3(matrix) * vertex.Bitangent;
+                for (int k = 0; k < MAX_BONE_INFLUENCE; ++k)
+                {
+                    vertex.m_BoneIDs[k] = -1;
+                    vertex.m_Weights[k] = 0.0f;
+                }
+                group.vertices.push_back(vertex);
+            }
+
+            // batches are drawn at full detail, LODs only exist per mesh
+            for (unsigned int k = 0; k < mesh.lods[0].indexCount; ++k)
+                group.indices.push_back(base + mesh.indices[k]);
+            meshCount++;
+        }
+    }
+
+    for (unsigned int g = 0; g < groups.size(); ++g)
+    {
+        Group& group = groups[g];
+        unsigned int triangleCount = static_cast<unsigned int>(group.indices.size() / 3);
+        if (triangleCount == 0) continue;
+
+        centroids.resize(triangleCount);
+        vector<unsigned int> order(triangleCount);
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            order[t] = t;
+            centroids[t] = (group.vertices[group.indices[t * 3]].Position + group.vertices[group.indices[t * 3 + 1]].Position +
+                            group.vertices[group.indices[t * 3 + 2]].Position) / 3.0f;
+        }
+
+        Batch batch;
+        batch.textures = group.textures;
+        SplitChunks(batch, group.vertices, group.indices, order, 0, triangleCount);
+
+        vector<unsigned int> sorted(group.indices.size());
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            for (int k = 0; k < 3; ++k) sorted[t * 3 + k] = group.indices[order[t] * 3 + k];
+        }
+
+        Upload(batch, group.vertices, sorted);
+        chunkCount += static_cast<int>(batch.chunks.size());
+        memory += group.vertices.size() * sizeof(Vertex) + sorted.size() * sizeof(unsigned int);
+        batches.push_back(batch);
+    }
+
+    bakeTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void StaticBatcher::SplitChunks(Batch& batch, const vector<Vertex>& vertices, const vector<unsigned int>& indices, vector<unsigned int>& order, unsigned int first, unsigned int count)
+{
+    AABB centroidBounds;
+    for (unsigned int i = first; i < first + count; ++i) centroidBounds.Expand(centroids[order[i]]);
+    glm::vec3 extent = centroidBounds.Extent();
+
+    if (count <= trianglesPerChunk || glm::max(extent.x, glm::max(extent.y, extent.z)) <= 0.0f)
+    {
+        Chunk chunk;
+        chunk.indexOffset = first * 3;
+        chunk.indexCount = count * 3;
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            for (int k = 0; k < 3; ++k) chunk.bounds.Expand(vertices[indices[order[i] * 3 + k]].Position);
+        }
+        batch.chunks.push_back(chunk);
+        return;
+    }
+
+    // median split along the longest axis, chunks come out in depth first order so neighbours are close in space
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    unsigned int half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+        [&](unsigned int l, unsigned int r) { return centroids[l][axis] < centroids[r][axis]; });
+
+    SplitChunks(batch, vertices, indices, order, first, half);
+    SplitChunks(batch, vertices, indices, order, first + half, count - half);
+}
+
+void StaticBatcher::Upload(Batch& batch, const vector<Vertex>& vertices, const vector<unsigned int>& indices)
+{
+    glGenVertexArrays(1, &batch.VAO);
+    glGenBuffers(1, &batch.VBO);
+    glGenBuffers(1, &batch.EBO);
+
+    glBindVertexArray(batch.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+    Mesh::SetVertexAttributes();
+    glBindVertexArray(0);
+}
+
+void StaticBatcher::Clear()
+{
+    for (unsigned int i = 0; i < batches.size(); ++i)
+    {
+        glDeleteVertexArrays(1, &batches[i].VAO);
+        glDeleteBuffers(1, &batches[i].VBO);
+        glDeleteBuffers(1, &batches[i].EBO);
+    }
+    batches.clear();
+    bakedModels.clear();
+    chunkCount = meshCount = 0;
+    memory = 0;
+}
+
+bool StaticBatcher::IsBaked(const Model* model) const
+{
+    return std::find(bakedModels.begin(), bakedModels.end(), model) != bakedModels.end();
+}
+
+void StaticBatcher::Draw(Shader& shader, const RenderView& view)
+{
+    PROFILE_FUNCTION();
+
+    // vertices are already in world space
+    shader.setMat4("model", glm::mat4(1.0f));
+
+    for (unsigned int b = 0; b < batches.size(); ++b)
+    {
+        const Batch& batch = batches[b];
+
+        // neighbouring visible chunks are merged into one range
+        drawCounts.clear();
+        drawOffsets.clear();
+        unsigned int triangles = 0;
+        bool previousVisible = false;
+        for (unsigned int i = 0; i < batch.chunks.size(); ++i)
+        {
+            const Chunk& chunk = batch.chunks[i];
+            bool visible = view.frustum.IntersectsAABB(chunk.bounds) && (!view.occlusion || view.occlusion->IsVisible(chunk.bounds));
+
+            renderStats.staticChunks++;
+            if (visible)
+            {
+                renderStats.staticChunksVisible++;
+                triangles += chunk.indexCount / 3;
+                if (previousVisible)
+                    drawCounts.back() += chunk.indexCount;
+                else
+                {
+                    drawCounts.push_back(chunk.indexCount);
+                    drawOffsets.push_back((void*)(chunk.indexOffset * sizeof(unsigned int)));
+                }
+            }
+            previousVisible = visible;
+        }
+        if (drawCounts.empty()) continue;
+
+        Mesh::BindTextures(shader, batch.textures);
+
+        glBindVertexArray(batch.VAO);
+        glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(), static_cast<GLsizei>(drawCounts.size()));
+        glBindVertexArray(0);
+
+        renderStats.drawCalls++;
+        renderStats.triangles += triangles;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+}
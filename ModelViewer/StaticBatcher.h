@@ -0,0 +1,68 @@
+#ifndef STATIC_BATCHER_H
+#define STATIC_BATCHER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Mesh.h"
+#include "RenderView.h"
+
+class Model;
+
+// Bakes meshes of models that never move into world space and merges the ones sharing a texture set into one buffer.
+// Every batch is split into spatial chunks that are culled on their own, the visible ones are drawn with one multi draw.
+class StaticBatcher
+{
+public:
+    // rebuilds all batches from the given models and their model matrices, previous batches are released
+    void Bake(const std::vector<std::pair<Model*, glm::mat4>>& models);
+    void Clear();
+
+    // true if the model's meshes are drawn by the batches
+    bool IsBaked(const Model* model) const;
+
+    // expects the shader to be in use with view and projection set
+    void Draw(Shader& shader, const RenderView& view);
+
+    int GetBatchCount() const { return static_cast<int>(batches.size()); }
+    int GetChunkCount() const { return chunkCount; }
+    int GetMeshCount() const { return meshCount; }
+    size_t GetMemory() const { return memory; }
+    float GetBakeTime() const { return bakeTime; }
+
+    // chunks are split until they have at most this many triangles
+    unsigned int trianglesPerChunk = 16384;
+
+private:
+    struct Chunk {
+        unsigned int indexOffset;
+        unsigned int indexCount;
+        AABB bounds;
+    };
+
+    struct Batch {
+        vector<Texture> textures;
+        vector<Chunk> chunks;
+        unsigned int VAO, VBO, EBO;
+    };
+
+    // sorts the triangles in order[first, first + count) so every chunk is one range of it
+    void SplitChunks(Batch& batch, const vector<Vertex>& vertices, const vector<unsigned int>& indices, vector<unsigned int>& order, unsigned int first, unsigned int count);
+    void Upload(Batch& batch, const vector<Vertex>& vertices, const vector<unsigned int>& indices);
+
+    vector<Batch> batches;
+    vector<const Model*> bakedModels;
+    int chunkCount = 0, meshCount = 0;
+    size_t memory = 0;
+    float bakeTime = 0.0f;
+
+    // per frame visible ranges, kept to avoid allocations
+    vector<GLsizei> drawCounts;
+    vector<void*> drawOffsets;
+    vector<glm::vec3> centroids;
+};
+
+#endif
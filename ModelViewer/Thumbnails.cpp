@@ -0,0 +1,283 @@
+#include "Thumbnails.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Model.h"
+#include "Camera.h"
+#include "ShaderVariants.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    unsigned int Crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+    {
+        static unsigned int table[256];
+        static bool tableReady = false;
+        if (!tableReady)
+        {
+            for (unsigned int i = 0; i < 256; ++i)
+            {
+                unsigned int c = i;
+                for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                table[i] = c;
+            }
+            tableReady = true;
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void PutBigEndian(std::vector<unsigned char>& out, unsigned int value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<unsigned char>(value >> shift));
+    }
+
+    void PutChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+    {
+        PutBigEndian(out, static_cast<unsigned int>(data.size()));
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        PutBigEndian(out, Crc32(&out[start], out.size() - start));
+    }
+
+    // RGB image, rows top to bottom. Deflate stored blocks only, thumbnails are small and this keeps zlib out
+    bool WritePNG(const std::string& path, int width, int height, const unsigned char* rgb)
+    {
+        std::vector<unsigned char> raw;
+        raw.reserve((width * 3 + 1) * height);
+        for (int y = 0; y < height; ++y)
+        {
+            raw.push_back(0); // no filter
+            raw.insert(raw.end(), rgb + y * width * 3, rgb + (y + 1) * width * 3);
+        }
+
+        std::vector<unsigned char> zlib = { 0x78, 0x01 };
+        for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535)
+        {
+            unsigned int length = static_cast<unsigned int>(std::min<size_t>(65535, raw.size() - offset));
+            zlib.push_back(offset + length >= raw.size() ? 1 : 0);
+            zlib.push_back(length & 0xff);
+            zlib.push_back(length >> 8);
+            zlib.push_back(~length & 0xff);
+            zlib.push_back((~length >> 8) & 0xff);
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+            if (raw.empty()) break;
+        }
+        unsigned int a = 1, b = 0;
+        for (size_t i = 0; i < raw.size(); ++i)
+        {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        PutBigEndian(zlib, (b << 16) | a);
+
+        std::vector<unsigned char> header;
+        PutBigEndian(header, width);
+        PutBigEndian(header, height);
+        header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bit RGB
+
+        std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        PutChunk(png, "IHDR", header);
+        PutChunk(png, "IDAT", zlib);
+        PutChunk(png, "IEND", {});
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(png.data()), png.size());
+        return static_cast<bool>(file);
+    }
+
+    GLFWwindow* CreateHeadlessContext()
+    {
+#ifdef GLFW_PLATFORM_NULL
+        // GLFW 3.4 doesn't need a display server at all with the null platform
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+        if (!glfwInit()) return nullptr;
+
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        GLFWwindow* window = nullptr;
+#ifndef _WIN32
+        // the window is never shown and everything renders into an FBO, EGL first and Mesa's OSMesa
+        // software rasterizer on machines without a GPU
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        window = glfwCreateWindow(64, 64, "ModelViewer thumbnails", NULL, NULL);
+        if (!window)
+        {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            window = glfwCreateWindow(64, 64, "ModelViewer thumbnails", NULL, NULL);
+        }
+#endif
+        if (!window)
+        {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+            window = glfwCreateWindow(64, 64, "ModelViewer thumbnails", NULL, NULL);
+        }
+        return window;
+    }
+}
+
+int RenderThumbnails(const std::string& modelDir, const std::string& outputDir, int size, int angles)
+{
+    PROFILE_THREAD("Main");
+
+    // same formats the file browser offers
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (auto& entry : std::filesystem::directory_iterator(modelDir, error))
+    {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (entry.is_regular_file() && (extension == ".obj" || extension == ".fbx" || extension == ".dae"))
+            paths.push_back(entry.path().generic_string());
+    }
+    if (error)
+    {
+        std::cout << "ERROR::THUMBNAILS::DIRECTORY_NOT_READ: " << modelDir << " " << error.message() << std::endl;
+        return -1;
+    }
+    std::sort(paths.begin(), paths.end());
+    std::filesystem::create_directories(outputDir, error);
+
+    GLFWwindow* window = CreateHeadlessContext();
+    if (window == NULL)
+    {
+        std::cout << "Failed to create headless GL context" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+
+    // offscreen target
+    unsigned int fbo, color, depth;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB8, size, size);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "ERROR::THUMBNAILS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glViewport(0, 0, size, size);
+    glEnable(GL_DEPTH_TEST);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // thumbnails show the bind pose, the static variant is all that's needed
+    ShaderVariants shaders("vShader.vx", "fShader.ft");
+    Shader& shader = shaders.Get("");
+
+    std::vector<unsigned char> pixels(size * size * 3), flipped(size * size * 3);
+    auto start = std::chrono::steady_clock::now();
+    float loadTime = 0.0f;
+    int rendered = 0;
+
+    // a batch is loaded in parallel, then uploaded, rendered and released before the next one
+    int batchSize = JobSystem::Get().GetThreadCount() * 2;
+    for (int first = 0; first < static_cast<int>(paths.size()); first += batchSize)
+    {
+        int count = std::min(batchSize, static_cast<int>(paths.size()) - first);
+        std::vector<Model*> batch(count, nullptr);
+
+        auto loadStart = std::chrono::steady_clock::now();
+        JobSystem::Get().ParallelFor(count, 1, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                PROFILE_SCOPE("LoadThumbnailModel");
+                batch[i] = new Model(paths[first + i], false, false, true);
+            }
+        });
+        loadTime += std::chrono::duration<float>(std::chrono::steady_clock::now() - loadStart).count();
+
+        for (int i = 0; i < count; ++i)
+        {
+            PROFILE_SCOPE("RenderThumbnail");
+            Model* model = batch[i];
+            AABB bounds = model->GetBounds();
+            if (!bounds.IsValid())
+            {
+                std::cout << "ERROR::THUMBNAILS::EMPTY_MODEL: " << paths[first + i] << std::endl;
+                model->Release();
+                delete model;
+                continue;
+            }
+            model->Upload();
+
+            glm::vec3 center = bounds.Center(), extent = bounds.Extent();
+            Camera camera;
+            camera.MoveToObject(glm::vec3(0.0f), extent, center, glm::vec3(1.0f));
+            float distance = glm::length(camera.GetCameraPosition() - center);
+            float radius = glm::max(glm::length(extent) * 0.5f, 0.0001f);
+            glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, glm::max(radius * 0.01f, distance - radius * 2.0f), distance + radius * 2.0f);
+
+            shader.use();
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", camera.GetViewMatrix());
+
+            std::string name = std::filesystem::path(paths[first + i]).stem().string();
+            for (int angle = 0; angle < angles; ++angle)
+            {
+                // the model turns around its center, the camera stays where MoveToObject put it
+                glm::mat4 matrix = glm::translate(glm::mat4(1.0f), center);
+                matrix = glm::rotate(matrix, glm::radians(360.0f * angle / angles), glm::vec3(0.0f, 1.0f, 0.0f));
+                matrix = glm::translate(matrix, -center);
+                shader.setMat4("model", matrix);
+
+                glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                model->Draw(shader);
+
+                glReadPixels(0, 0, size, size, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+                for (int y = 0; y < size; ++y)
+                    std::copy(&pixels[(size - 1 - y) * size * 3], &pixels[(size - y) * size * 3], &flipped[y * size * 3]);
+
+                std::string path = outputDir + "/" + name + "_" + std::to_string(angle) + ".png";
+                if (!WritePNG(path, size, size, flipped.data()))
+                    std::cout << "ERROR::THUMBNAILS::PNG_NOT_WRITTEN: " << path << std::endl;
+            }
+
+            model->Release();
+            delete model;
+            rendered++;
+        }
+    }
+
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Thumbnails: " << rendered << " of " << paths.size() << " models, " << rendered * angles << " images in " << seconds << " s ("
+              << (seconds > 0.0f ? rendered / seconds : 0.0f) << " models/s, loading " << loadTime << " s on "
+              << JobSystem::Get().GetThreadCount() << " threads)" << std::endl;
+
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
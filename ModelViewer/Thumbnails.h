@@ -0,0 +1,11 @@
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+
+#include <string>
+
+// Headless batch mode: renders every model of a directory offscreen from a few angles and writes PNG thumbnails
+// named <model>_<angle>.png into outputDir. Models are loaded on the job system workers, GL work stays on the
+// calling thread. Returns the process exit code.
+int RenderThumbnails(const std::string& modelDir, const std::string& outputDir, int size = 256, int angles = 4);
+
+#endif
@@ -15,6 +15,20 @@
 #include "Camera.h"
 #include "Model.h"
 #include "Animator.h"
+#include "GpuTimer.h"
+#include "Profiler.h"
+#include "RenderView.h"
+#include "RenderStats.h"
+#include "OcclusionCuller.h"
+#include "SceneBVH.h"
+#include "StaticBatcher.h"
+#include "ShaderVariants.h"
+#include "SkinningPass.h"
+#include "BonePalette.h"
+#include "Thumbnails.h"
+#include "SkeletonBenchmark.h"
+#include "CrowdRenderer.h"
+#include "JobSystem.h"
 
 #include <iostream>
 #include <format>
@@ -32,11 +46,18 @@ void processInput(GLFWwindow* window);
 
 // drawing
 void ImGuiRender(ImGuiIO& io);
-void SetnDrawModel(Shader& shader, Model& modelObj, Animator& animator, glm::vec3 scale, glm::vec3 pos);
-void Drawing(GLFWwindow* window, Shader& ourShader);
+void SetnDrawModel(ShaderVariants& shaders, Model& modelObj, int boneOffset, glm::vec3 scale, glm::vec3 pos, const RenderView& renderView);
+void Drawing(GLFWwindow* window, ShaderVariants& modelShaders);
+void DrawModels(ShaderVariants& modelShaders, const RenderView& renderView, bool timed);
+void OcclusionPass(RenderView& renderView);
+void SceneQueries(RenderView& renderView);
+void RebuildScene();
+void SpawnCrowd();
+glm::mat4 ModelMatrix(Model& modelObj, glm::vec3 scale, glm::vec3 pos);
 void MenuDraw();
 void HelpMenu();
 void DrawCoordinates();
+void DrawStats();
 
 pair<Model*, pair<Animation*, Animator*>> LoadModel(string pathToModel, bool moveable, float pos[3], float scale);
 
@@ -72,8 +93,65 @@ progState state = MENU;
 bool KeysProcessed[1024], Keys[1024];
 bool helpMenu = true;
 
-int main()
+// gpu pass timings
+GpuTimer gpuTimer;
+
+// software occlusion culling
+OcclusionCuller occlusionCuller;
+bool occlusionCulling = true;
+int maxOccluders = 8;
+float minOccluderSize = 64.0f; // projected diameter in pixels
+
+// world space bounds of all meshes, for culling, picking and framing
+SceneBVH sceneBVH;
+bool bvhCulling = true;
+vector<int> visibleItems;
+unsigned int visibilityStamp = 0;
+string pickedName = "none";
+
+// non-moveable models baked into world space batches
+StaticBatcher staticBatcher;
+bool bakeStatic = false;
+bool staticBaked = false;
+
+// animated meshes skinned once per frame with transform feedback, pays off with more than one geometry pass
+SkinningPass skinningPass;
+bool preSkinning = false;
+bool depthPrepass = false;
+
+// bones of all animated models for this frame, boneOffsets[i] is where model i starts, -1 when they didn't fit
+BonePalette bonePalette;
+vector<int> boneOffsets;
+vector<Animator*> animated;
+// LOD picked for each animator this frame and whether it evaluated a pose
+vector<AnimationLod> animationLods;
+vector<char> animationEvaluated;
+// poses shared by animators playing the same clip at nearly the same time, see poseCacheSettings
+PoseCache poseCache;
+
+// instanced copies of one animated model playing baked clips on the GPU
+CrowdRenderer crowd;
+int crowdSize = 256;
+
+// clips by file, every model loaded from the same file plays the same read only Animation
+map<string, Animation*> loadedClips;
+
+// animation clips compressed when they are loaded
+bool compressClips = false;
+ClipCompressionSettings clipCompression;
+ClipCompressionReport clipReport;
+
+int main(int argc, char** argv)
 {
+    // ModelViewer --thumbnails <model dir> <output dir> [size]
+    if (argc >= 4 && std::string(argv[1]) == "--thumbnails")
+        return RenderThumbnails(argv[2], argv[3], argc >= 5 ? std::atoi(argv[4]) : 256);
+    // ModelViewer --benchmark-skeleton [nodes]
+    if (argc >= 2 && std::string(argv[1]) == "--benchmark-skeleton")
+        return RunSkeletonBenchmark(argc >= 3 ? std::atoi(argv[2]) : 200);
+
+    PROFILE_THREAD("Main");
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -121,12 +199,19 @@ int main()
     
     glEnable(GL_DEPTH_TEST);
 
-    Shader ourShader("vShader.vx", "fShader.ft");
+    // static variant is needed right away, skinned ones compile when the first animated model shows up
+    ShaderVariants modelShaders("vShader.vx", "fShader.ft");
+    modelShaders.Get("");
 
     // ------------------------- MAIN LOOP STARTED -------------------------
 
     while (!glfwWindowShouldClose(window)) 
     {
+        PROFILE_FRAME();
+        PROFILE_SCOPE("Frame");
+
+        gpuTimer.BeginFrame();
+
         glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -135,13 +220,18 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        sceneBVH.ResetCounters();
         processInput(window);
 
-        Drawing(window, ourShader);
+        Drawing(window, modelShaders);
   
         // imgui:Render + glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         ImGuiRender(io);
-        glfwSwapBuffers(window);
+        gpuTimer.EndFrame();
+        {
+            PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
@@ -159,6 +249,8 @@ int main()
 
 void processInput(GLFWwindow* window)
 {
+    PROFILE_FUNCTION();
+
     if (glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
@@ -201,6 +293,14 @@ void processInput(GLFWwindow* window)
         Keys[GLFW_KEY_ESCAPE] = false;
         KeysProcessed[GLFW_KEY_ESCAPE] = false;
     }
+    // F key
+    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+        Keys[GLFW_KEY_F] = true;
+    else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE)
+    {
+        Keys[GLFW_KEY_F] = false;
+        KeysProcessed[GLFW_KEY_F] = false;
+    }
     // H key
     if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
         Keys[GLFW_KEY_H] = true;
@@ -219,6 +319,16 @@ void processInput(GLFWwindow* window)
 
         KeysProcessed[GLFW_KEY_ESCAPE] = true;
     }
+    if (Keys[GLFW_KEY_F] && !KeysProcessed[GLFW_KEY_F]) {
+        // frame the mesh closest to the camera
+        int item = sceneBVH.IsCurrent() ? sceneBVH.Nearest(camera.GetCameraPosition()) : -1;
+        if (item >= 0) {
+            const AABB& bounds = sceneBVH.GetItem(item).bounds;
+            camera.MoveToObject(zeroVec, bounds.Extent(), bounds.Center(), singleVec);
+        }
+
+        KeysProcessed[GLFW_KEY_F] = true;
+    }
     if (Keys[GLFW_KEY_H] && !KeysProcessed[GLFW_KEY_H]) {
         helpMenu = !helpMenu;
 
@@ -228,38 +338,53 @@ void processInput(GLFWwindow* window)
 
 void ImGuiRender(ImGuiIO& io)
 {
+    PROFILE_FUNCTION();
+
     ImGui::Render();
+
+    gpuTimer.Begin("ImGui");
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    gpuTimer.End();
 
     if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
     {
+        // platform windows render in their own contexts and query objects aren't shared between contexts,
+        // so this only approximates their cost as seen from the main context
+        gpuTimer.Begin("ImGui viewports");
         GLFWwindow* backup_current_context = glfwGetCurrentContext();
         ImGui::UpdatePlatformWindows();
         ImGui::RenderPlatformWindowsDefault();
         glfwMakeContextCurrent(backup_current_context);
+        gpuTimer.End();
     }
 }
 
-void SetnDrawModel(Shader& shader, Model& modelObj, Animator& animator, glm::vec3 scale, glm::vec3 pos)
+void SetnDrawModel(ShaderVariants& shaders, Model& modelObj, int boneOffset, glm::vec3 scale, glm::vec3 pos, const RenderView& renderView)
 {
+    PROFILE_FUNCTION();
+
+    string defines = modelObj.GetShaderDefines();
+    Shader& shader = shaders.Get(defines);
     shader.use();
 
     // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 8000.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    shader.setMat4("projection", projection);
-    shader.setMat4("view", view);
-
-    if (modelObj.IsAnimated()) {
-        shader.setBool("animated", true);
+    shader.setMat4("projection", renderView.projection);
+    shader.setMat4("view", renderView.view);
 
-        auto transforms = animator.GetFinalBoneMatrices();
-        for (int i = 0; i < transforms.size(); ++i)
-            shader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
+    // static and pre-skinned models draw without the bone palette
+    if (!defines.empty()) {
+        shader.setInt("bonePalette", BonePalette::TEXTURE_UNIT);
+        shader.setInt("boneOffset", boneOffset);
     }
-    else shader.setBool("animated", false);
 
     // render the loaded model
+    glm::mat4 model = ModelMatrix(modelObj, scale, pos);
+    shader.setMat4("model", model);
+    modelObj.Draw(shader, renderView, model);
+}
+
+glm::mat4 ModelMatrix(Model& modelObj, glm::vec3 scale, glm::vec3 pos)
+{
     glm::mat4 model = glm::mat4(1.0f);
     if (modelObj.IsMoveable()) {
         model = glm::translate(model, pos + moveVec); // translate it down so it's at the center of the scene
@@ -268,24 +393,299 @@ void SetnDrawModel(Shader& shader, Model& modelObj, Animator& animator, glm::vec
         model = glm::translate(model, pos); // translate it down so it's at the center of the scene
     }
     model = glm::scale(model, scale);	// it's a bit too big for our scene, so scale it down
-    shader.setMat4("model", model);
-    modelObj.Draw(shader);
+    return model;
+}
+
+void OcclusionPass(RenderView& renderView)
+{
+    PROFILE_FUNCTION();
+
+    struct Candidate {
+        float size;
+        Model* model;
+        Mesh* mesh;
+        glm::mat4 matrix;
+    };
+    static vector<Candidate> candidates;
+    candidates.clear();
+
+    // the biggest static meshes on screen are the occluders, only the ones in the frustum if the BVH was queried
+    if (renderView.visibilityStamp)
+    {
+        for (int i = 0; i < visibleItems.size(); i++)
+        {
+            const SceneBVH::Item& item = sceneBVH.GetItem(visibleItems[i]);
+            Mesh& mesh = item.model->meshes[item.mesh];
+            if (mesh.IsSkinned() || mesh.vertices.empty()) continue;
+
+            float scale = glm::max(glm::length(glm::vec3(item.matrix[0])), glm::max(glm::length(glm::vec3(item.matrix[1])), glm::length(glm::vec3(item.matrix[2]))));
+            glm::vec3 center = glm::vec3(item.matrix * glm::vec4(mesh.sphere.center, 1.0f));
+            float size = renderView.ProjectedSize(center, mesh.sphere.radius * scale);
+            if (size >= minOccluderSize) candidates.push_back({ size, item.model, &mesh, item.matrix });
+        }
+    }
+    else for (int i = 0; i < models.size(); i++)
+    {
+        Model& modelObj = *models[i].first;
+        glm::mat4 matrix = ModelMatrix(modelObj, modelObj.GetScaleVec(), modelObj.GetPosVec());
+        float scale = glm::max(modelObj.GetScaleVec().x, glm::max(modelObj.GetScaleVec().y, modelObj.GetScaleVec().z));
+
+        for (unsigned int j = 0; j < modelObj.meshes.size(); j++)
+        {
+            Mesh& mesh = modelObj.meshes[j];
+            if (mesh.IsSkinned() || mesh.vertices.empty()) continue;
+
+            glm::vec3 center = glm::vec3(matrix * glm::vec4(mesh.sphere.center, 1.0f));
+            float size = renderView.ProjectedSize(center, mesh.sphere.radius * scale);
+            if (size >= minOccluderSize) candidates.push_back({ size, &modelObj, &mesh, matrix });
+        }
+    }
+
+    int count = glm::min(maxOccluders, static_cast<int>(candidates.size()));
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+        [](const Candidate& l, const Candidate& r) { return l.size > r.size; });
+
+    occlusionCuller.BeginFrame(renderView.viewProj);
+    for (int i = 0; i < count; i++)
+    {
+        // coarsest LOD is good enough to hide things behind it
+        Mesh& mesh = *candidates[i].mesh;
+        const MeshLod& lod = mesh.lods.back();
+        occlusionCuller.AddOccluder(&mesh.vertices[0].Position, sizeof(Vertex), &mesh.indices[lod.indexOffset], lod.indexCount, candidates[i].matrix);
+    }
+    occlusionCuller.Rasterize();
+
+    renderStats.occluders = occlusionCuller.GetOccluderCount();
+    renderStats.occluderTriangles = occlusionCuller.GetTriangleCount();
+    renderView.occlusion = &occlusionCuller;
+}
+
+void RebuildScene()
+{
+    vector<SceneBVH::Item> items;
+    for (int i = 0; i < models.size(); i++)
+    {
+        Model& modelObj = *models[i].first;
+        SceneBVH::AddModel(items, &modelObj, ModelMatrix(modelObj, modelObj.GetScaleVec(), modelObj.GetPosVec()));
+    }
+    sceneBVH.Rebuild(items);
+
+    // batches are baked again before the next draw
+    staticBaked = false;
+
+    // the crowd's model was deleted
+    bool crowdModelLoaded = false;
+    for (int i = 0; i < models.size(); i++) crowdModelLoaded |= models[i].first == crowd.GetModel();
+    if (crowd.GetModel() && !crowdModelLoaded) {
+        crowd.Clear();
+        crowd.ClearInstances();
+    }
+}
+
+void SpawnCrowd()
+{
+    PROFILE_FUNCTION();
+
+    int source = -1;
+    for (int i = 0; i < models.size(); i++)
+        if (models[i].second.first) source = i;
+    if (source < 0) return;
+
+    Model& modelObj = *models[source].first;
+    crowd.Bake(modelObj, { models[source].second.first });
+    crowd.ClearInstances();
+
+    // square grid next to the model, spaced by its size, every instance starts somewhere else in the clip
+    glm::vec3 spacing = modelObj.GetSize() * modelObj.GetScaleVec() * 1.5f;
+    int side = static_cast<int>(glm::ceil(glm::sqrt(static_cast<float>(crowdSize))));
+    for (int i = 0; i < crowdSize; i++)
+    {
+        glm::vec3 offset = glm::vec3((i % side + 1) * spacing.x, 0.0f, (i / side) * spacing.z);
+        float timeOffset = static_cast<float>((i * 7919) % 1000) / 1000.0f * 10.0f;
+        float speed = 0.8f + static_cast<float>((i * 104729) % 400) / 1000.0f;
+        crowd.AddInstance(ModelMatrix(modelObj, modelObj.GetScaleVec(), modelObj.GetPosVec() + offset), 0, timeOffset, speed);
+    }
+}
+
+void SceneQueries(RenderView& renderView)
+{
+    PROFILE_FUNCTION();
+
+    static glm::vec3 lastMoveVec = zeroVec;
+    static float lastRotAngle = 0.0f;
+
+    // a finished build has the transforms from when it started, moveable models are refitted then as well
+    bool rebuilt = sceneBVH.Update();
+    if (!sceneBVH.IsCurrent()) return;
+
+    if (rebuilt || moveVec != lastMoveVec || rotAngle != lastRotAngle)
+    {
+        for (int i = 0; i < models.size(); i++)
+        {
+            Model& modelObj = *models[i].first;
+            if (modelObj.IsMoveable())
+                sceneBVH.UpdateModel(&modelObj, ModelMatrix(modelObj, modelObj.GetScaleVec(), modelObj.GetPosVec()));
+        }
+        lastMoveVec = moveVec;
+        lastRotAngle = rotAngle;
+    }
+
+    if (bvhCulling)
+    {
+        if (++visibilityStamp == 0) visibilityStamp = 1;
+
+        sceneBVH.QueryFrustum(renderView.frustum, visibleItems);
+        for (int i = 0; i < visibleItems.size(); i++)
+        {
+            const SceneBVH::Item& item = sceneBVH.GetItem(visibleItems[i]);
+            item.model->meshes[item.mesh].visibleStamp = visibilityStamp;
+        }
+        renderView.visibilityStamp = visibilityStamp;
+    }
+
+    // left click in the menu picks the mesh under the cursor
+    ImGuiIO& io = ImGui::GetIO();
+    if (state == MENU && ImGui::IsMouseClicked(ImGuiMouseButton_Left) && !io.WantCaptureMouse)
+    {
+        glm::vec2 ndc = glm::vec2(io.MousePos.x / io.DisplaySize.x, 1.0f - io.MousePos.y / io.DisplaySize.y) * 2.0f - 1.0f;
+        glm::mat4 inverseViewProj = glm::inverse(renderView.viewProj);
+        glm::vec4 nearPoint = inverseViewProj * glm::vec4(ndc, -1.0f, 1.0f);
+        glm::vec4 farPoint = inverseViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+        glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+        glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+        float distance;
+        int item = sceneBVH.Raycast(origin, direction, &distance);
+        if (item >= 0)
+            pickedName = sceneBVH.GetItem(item).model->name + ", mesh " + std::to_string(sceneBVH.GetItem(item).mesh) + ", " + std::to_string(distance) + " away";
+        else
+            pickedName = "none";
+    }
 }
 
-void Drawing(GLFWwindow* window, Shader& ourShader)
+void Drawing(GLFWwindow* window, ShaderVariants& modelShaders)
 {
+    PROFILE_FUNCTION();
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    // Objects drawing
+    renderStats.Reset();
+
+    // view/projection transformations
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 8000.0f);
+    RenderView renderView(camera.GetViewMatrix(), projection, camera.GetCameraPosition(), static_cast<float>(fbHeight));
+
+    SceneQueries(renderView);
+    if (occlusionCulling) OcclusionPass(renderView);
+
+    if (!bakeStatic && staticBaked) {
+        staticBatcher.Clear();
+        staticBaked = false;
+    }
+    if (bakeStatic && !staticBaked) {
+        vector<pair<Model*, glm::mat4>> statics;
+        for (int i = 0; i < models.size(); i++)
+            statics.push_back(make_pair(models[i].first, ModelMatrix(*models[i].first, models[i].first->GetScaleVec(), models[i].first->GetPosVec())));
+        staticBatcher.Bake(statics);
+        staticBaked = true;
+    }
+
+    // every animator only touches its own clip and matrices, so they update in parallel and give the same
+    // result on any number of threads. ParallelFor returning is the barrier before the palette is filled.
+    // The pose cache only shares full poses, which are the same whichever animator evaluates them
+    animated.clear();
+    animationLods.clear();
+    for (int i = 0; i < models.size(); i++)
+    {
+        Model& modelObj = *models[i].first;
+        if (!modelObj.IsAnimated()) continue;
+
+        // LOD from the world bounds: rate and bone count follow the size on screen, the frustum decides off screen
+        AABB bounds = modelObj.GetBounds().Transformed(ModelMatrix(modelObj, modelObj.GetScaleVec(), modelObj.GetPosVec()));
+        bool visible = bounds.IsValid() && renderView.frustum.IntersectsAABB(bounds);
+        float size = visible ? renderView.ProjectedSize(bounds.Center(), glm::length(bounds.Extent()) * 0.5f) : 0.0f;
+        AnimationLod lod = ChooseAnimationLod(size, visible);
+
+        if (!visible) renderStats.animatorsOffscreen++;
+        else if (lod.interval > 1) renderStats.animatorsReducedRate++;
+        else renderStats.animatorsFull++;
+        if (visible && lod.maxDepth >= 0) renderStats.animatorsReducedBones++;
+
+        animated.push_back(models[i].second.second);
+        animationLods.push_back(lod);
+    }
+    animationEvaluated.assign(animated.size(), 0);
+    PoseCache* sharedPoses = poseCacheSettings.enabled ? &poseCache : nullptr;
+    if (sharedPoses) poseCache.Begin(poseCacheSettings.step);
+    {
+        PROFILE_SCOPE("UpdateAnimations");
+        JobSystem::Get().ParallelFor(static_cast<int>(animated.size()), 1, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                PROFILE_SCOPE("UpdateAnimation");
+                animationEvaluated[i] = animated[i]->UpdateAnimation(deltaTime, animationLods[i], sharedPoses);
+            }
+        });
+    }
+    for (unsigned int i = 0; i < animationEvaluated.size(); i++)
+        renderStats.poseEvaluations += animationEvaluated[i];
+    if (sharedPoses)
+    {
+        renderStats.poseCacheHits = poseCache.GetHits();
+        renderStats.poseCacheMisses = poseCache.GetMisses();
+        renderStats.poseCacheSavedMs = poseCache.GetSavedMilliseconds();
+    }
+
+    crowd.Update(deltaTime);
+
+    bonePalette.Begin();
+    boneOffsets.assign(models.size(), 0);
     for (int i = 0; i < models.size(); i++)
     {
-        if (models[i].first->IsAnimated()) models[i].second.second->UpdateAnimation(deltaTime);
+        if (models[i].first->IsAnimated())
+        {
+            Animator* animator = models[i].second.second;
+            boneOffsets[i] = bonePalette.Add(animator, animator->GetBoneMatrices(), animator->GetPoseGeneration());
+        }
+    }
+    bonePalette.Upload();
 
-        SetnDrawModel(ourShader, *models[i].first, *models[i].second.second, models[i].first->GetScaleVec(), models[i].first->GetPosVec());
+    // releasing the buffers does no GPU work, the pass only shows up while it skins
+    if (preSkinning) gpuTimer.Begin("Skinning");
+    else gpuTimer.RemoveStat("Skinning");
+    for (int i = 0; i < models.size(); i++)
+    {
+        if (!models[i].first->IsAnimated() || boneOffsets[i] < 0) continue;
+        if (preSkinning) skinningPass.Skin(*models[i].first, boneOffsets[i]);
+        else skinningPass.Release(*models[i].first);
+    }
+    if (preSkinning) gpuTimer.End();
+
+    // Objects drawing, the main pass only writes pixels that passed the prepass depth
+    renderStats.geometryPasses = depthPrepass ? 2 : 1;
+    if (depthPrepass) {
+        gpuTimer.Begin("Depth prepass");
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        // the prepass draws and culls the same meshes as the main pass, only its draws are kept apart
+        RenderStats mainPassStats = renderStats;
+        DrawModels(modelShaders, renderView, false);
+        int prepassDrawCalls = renderStats.drawCalls - mainPassStats.drawCalls;
+        long long prepassTriangles = renderStats.triangles - mainPassStats.triangles;
+        renderStats = mainPassStats;
+        renderStats.prepassDrawCalls = prepassDrawCalls;
+        renderStats.prepassTriangles = prepassTriangles;
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_LEQUAL);
+        gpuTimer.End();
     }
+    DrawModels(modelShaders, renderView, true);
+    glDepthFunc(GL_LESS);
 
     // Menu/Help drawing
     if (helpMenu) HelpMenu();
@@ -300,6 +700,41 @@ void Drawing(GLFWwindow* window, Shader& ourShader)
     }
 
     DrawCoordinates();
+    DrawStats();
+    gpuTimer.DrawWindow();
+    Profiler::DrawWindow();
+}
+
+void DrawModels(ShaderVariants& modelShaders, const RenderView& renderView, bool timed)
+{
+    PROFILE_FUNCTION();
+
+    for (int i = 0; i < models.size(); i++)
+    {
+        if (bakeStatic && staticBatcher.IsBaked(models[i].first)) continue;
+        // its bones didn't fit in the palette
+        if (boneOffsets[i] < 0) continue;
+
+        if (timed) gpuTimer.Begin(std::to_string(i) + ": " + models[i].first->name, "Models");
+        SetnDrawModel(modelShaders, *models[i].first, boneOffsets[i], models[i].first->GetScaleVec(), models[i].first->GetPosVec(), renderView);
+        if (timed) gpuTimer.End();
+    }
+
+    if (bakeStatic && staticBatcher.GetBatchCount()) {
+        if (timed) gpuTimer.Begin("Static batches", "Models");
+        Shader& staticShader = modelShaders.Get("");
+        staticShader.use();
+        staticShader.setMat4("projection", renderView.projection);
+        staticShader.setMat4("view", renderView.view);
+        staticBatcher.Draw(staticShader, renderView);
+        if (timed) gpuTimer.End();
+    }
+
+    if (crowd.GetInstanceCount()) {
+        if (timed) gpuTimer.Begin("Crowd", "Models");
+        crowd.Draw(modelShaders, renderView);
+        if (timed) gpuTimer.End();
+    }
 }
 
 void MenuDraw()
@@ -333,7 +768,11 @@ void MenuDraw()
 
 
         ImGui::SetCursorPos(ImVec2(130.0f, 75.0f));
-        if (ImGui::Button("Delete Last Model") && !models.empty()) models.pop_back();
+        if (ImGui::Button("Delete Last Model") && !models.empty()) {
+            gpuTimer.RemoveStat(std::to_string(models.size() - 1) + ": " + models.back().first->name);
+            models.pop_back();
+            RebuildScene();
+        }
     }
     else {
         // Model info tools
@@ -346,6 +785,7 @@ void MenuDraw()
         if (!pathToModel.empty()) {
             // loading model in modelVector
             models.push_back( LoadModel(pathToModel, checkMove, position, scale) ); // return pair <Model, modelInfo>
+            RebuildScene();
 
             // clear values for next model
             loadWindow = false, checkMove = false, state = ACTIVE, pathToModel.clear();
@@ -442,8 +882,146 @@ void DrawCoordinates()
     ImGui::End();
 }
 
+void DrawStats()
+{
+    static bool firstOpen = true;
+
+    if (firstOpen) {
+        ImGui::SetNextWindowSize(ImVec2(300, 240));
+        firstOpen = false;
+    }
+    ImGui::Begin("Stats");
+
+    ImGui::Text("Frame: %.2f ms", deltaTime * 1000.0f);
+    ImGui::Text("Draw calls: %d", renderStats.drawCalls);
+    ImGui::Text("Triangles: %lld", renderStats.triangles);
+    if (renderStats.geometryPasses > 1)
+        ImGui::Text("Depth prepass: %d draw calls, %lld tris", renderStats.prepassDrawCalls, renderStats.prepassTriangles);
+
+    // LODs
+    ImGui::Separator();
+    ImGui::Checkbox("Mesh LODs", &lodSettings.enabled);
+    for (int lod = 0; lod < MAX_MESH_LODS; ++lod)
+        ImGui::Text("LOD%d: %d meshes, %lld tris drawn", lod, renderStats.meshesPerLod[lod], renderStats.trianglesPerLod[lod]);
+
+    for (int i = 0; i < models.size(); ++i)
+    {
+        string counts;
+        for (int lod = 0; lod < MAX_MESH_LODS; ++lod)
+            counts += (lod ? " / " : "") + std::to_string(models[i].first->GetLodTriangleCount(lod));
+        ImGui::Text("%s: %s", models[i].first->name.c_str(), counts.c_str());
+    }
+
+    // clusters
+    ImGui::Separator();
+    ImGui::Checkbox("Cluster culling", &clusterSettings.enabled);
+    ImGui::SameLine();
+    ImGui::Checkbox("Backfacing", &clusterSettings.coneCulling);
+    ImGui::Text("Clusters: %d / %d visible", renderStats.clustersVisible, renderStats.clusters);
+
+    // occlusion
+    ImGui::Separator();
+    ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+    ImGui::Text("Occluders: %d (%d tris)", renderStats.occluders, renderStats.occluderTriangles);
+    ImGui::Text("Occluded meshes: %d / %d", renderStats.occlusionCulled, renderStats.occlusionTested);
+
+    // scene BVH
+    ImGui::Separator();
+    SceneBVH::Counters& counters = sceneBVH.GetCounters();
+    ImGui::Checkbox("BVH frustum culling", &bvhCulling);
+    ImGui::Text("BVH: %d items, %d nodes, built in %.2f ms%s", sceneBVH.GetItemCount(), sceneBVH.GetNodeCount(), sceneBVH.GetBuildTime(), sceneBVH.IsCurrent() ? "" : " (rebuilding)");
+    ImGui::Text("Outside frustum: %d meshes", renderStats.frustumCulled);
+    ImGui::Text("Queries: %d frustum, %d ray, %d nearest", counters.frustumQueries, counters.rayQueries, counters.nearestQueries);
+    ImGui::Text("Nodes visited: %d, refitted: %d", counters.nodesVisited, counters.refitNodes);
+    ImGui::Text("Picked: %s", pickedName.c_str());
+
+    // static batches
+    ImGui::Separator();
+    ImGui::Checkbox("Bake static geometry", &bakeStatic);
+    ImGui::Text("Batches: %d from %d meshes, chunks %d / %d visible", staticBatcher.GetBatchCount(), staticBatcher.GetMeshCount(), renderStats.staticChunksVisible, renderStats.staticChunks);
+    ImGui::Text("Baked: %.1f MB in %.2f ms", staticBatcher.GetMemory() / (1024.0f * 1024.0f), staticBatcher.GetBakeTime());
+
+    // skinning
+    ImGui::Separator();
+    ImGui::Checkbox("Pre-skinning", &preSkinning);
+    ImGui::SameLine();
+    ImGui::Checkbox("Depth prepass", &depthPrepass);
+    ImGui::Text("Bone palette: %d matrices (%.1f KB), %d uploaded", bonePalette.GetMatrixCount(), bonePalette.GetCapacity() / 1024.0f,
+                bonePalette.GetUploadedMatrices());
+    ImGui::Text("Geometry passes: %d, pre-skinned vertices: %d", renderStats.geometryPasses, renderStats.skinnedVertices);
+    if (preSkinning && renderStats.geometryPasses > 1)
+        ImGui::Text("Skinning saved: %d vertices (%d passes skin once)", renderStats.skinnedVertices * (renderStats.geometryPasses - 1), renderStats.geometryPasses);
+
+    // animation LOD
+    ImGui::Separator();
+    ImGui::Checkbox("Animation LOD", &animationLodSettings.enabled);
+    if (animationLodSettings.enabled)
+    {
+        ImGui::InputFloat2("Reduced rate below (px)", animationLodSettings.reducedRateSizes, "%.0f");
+        ImGui::InputInt2("Frames per pose", animationLodSettings.intervals);
+        ImGui::InputFloat("Reduced bones below (px)", &animationLodSettings.reducedBonesSize, 10.0f, 50.0f, "%.0f");
+        ImGui::InputInt("Reduced bone depth", &animationLodSettings.reducedDepth);
+        ImGui::Combo("Off screen", &animationLodSettings.offscreen, "Lowest rate\0Clock only\0Paused\0");
+        for (int i = 0; i < 2; i++) animationLodSettings.intervals[i] = glm::clamp(animationLodSettings.intervals[i], 1, 16);
+        animationLodSettings.reducedDepth = glm::max(animationLodSettings.reducedDepth, 0);
+    }
+    ImGui::Text("Animators: %d full, %d reduced rate, %d reduced bones, %d off screen", renderStats.animatorsFull,
+                renderStats.animatorsReducedRate, renderStats.animatorsReducedBones, renderStats.animatorsOffscreen);
+    ImGui::Text("Poses evaluated: %d of %d", renderStats.poseEvaluations, static_cast<int>(animated.size()));
+    ImGui::Checkbox("Share poses between instances", &poseCacheSettings.enabled);
+    if (poseCacheSettings.enabled)
+    {
+        ImGui::InputFloat("Pose time step (s)", &poseCacheSettings.step, 0.005f, 0.05f, "%.3f");
+        poseCacheSettings.step = glm::clamp(poseCacheSettings.step, 0.001f, 1.0f);
+        int lookups = renderStats.poseCacheHits + renderStats.poseCacheMisses;
+        ImGui::Text("Pose cache: %d of %d hits (%.0f%%), %d poses, %.2f ms saved", renderStats.poseCacheHits, lookups,
+                    lookups > 0 ? 100.0f * renderStats.poseCacheHits / lookups : 0.0f, poseCache.GetPoseCount(), renderStats.poseCacheSavedMs);
+    }
+
+    ImGui::Separator();
+    ImGui::InputInt("Crowd size", &crowdSize, 64, 1024);
+    crowdSize = glm::clamp(crowdSize, 1, crowd.GetMaxInstances());
+    if (ImGui::Button("Spawn crowd of last animated model")) SpawnCrowd();
+    ImGui::SameLine();
+    if (ImGui::Button("Clear crowd")) crowd.ClearInstances();
+    if (crowd.GetInstanceCount())
+        ImGui::Text("Crowd: %d instances, %d clips, %.1f KB baked in %.1f ms", crowd.GetInstanceCount(), crowd.GetClipCount(),
+                    crowd.GetTextureMemory() / 1024.0f, crowd.GetBakeTime());
+
+    ImGui::Separator();
+    ImGui::Checkbox("Compress clips on load", &compressClips);
+    if (compressClips)
+    {
+        ImGui::InputFloat("Position tolerance", &clipCompression.positionTolerance, 0.0001f, 0.001f, "%.4f");
+        ImGui::InputFloat("Rotation tolerance (deg)", &clipCompression.rotationTolerance, 0.01f, 0.1f, "%.3f");
+        ImGui::InputFloat("Scale tolerance", &clipCompression.scaleTolerance, 0.0001f, 0.001f, "%.4f");
+    }
+    size_t clipMemory = 0, animatorMemory = 0;
+    for (auto& clip : loadedClips) clipMemory += clip.second->GetMemory();
+    for (unsigned int i = 0; i < animated.size(); i++) animatorMemory += animated[i]->GetMemory();
+    ImGui::Text("Animation memory: %d clips %.1f KB, %d animators %.1f KB", static_cast<int>(loadedClips.size()), clipMemory / 1024.0f,
+                static_cast<int>(animated.size()), animatorMemory / 1024.0f);
+    int hierarchyNodes = 0, skeletonNodes = 0;
+    for (auto& clip : loadedClips)
+    {
+        hierarchyNodes += clip.second->GetHierarchyNodeCount();
+        skeletonNodes += static_cast<int>(clip.second->GetSkeleton().size());
+    }
+    ImGui::Text("Skeleton nodes: %d in the files, %d evaluated after pruning", hierarchyNodes, skeletonNodes);
+    if (clipReport.tracks > 0)
+    {
+        ImGui::Text("Clips: %d -> %d keys, %d of %d tracks constant", clipReport.keysBefore, clipReport.keysAfter, clipReport.constantTracks, clipReport.tracks);
+        ImGui::Text("Clip memory: %.1f KB -> %.1f KB", clipReport.bytesBefore / 1024.0f, clipReport.bytesAfter / 1024.0f);
+        ImGui::Text("Max error: %.5f pos, %.4f deg, %.5f scale", clipReport.maxPositionError, clipReport.maxRotationError, clipReport.maxScaleError);
+    }
+
+    ImGui::End();
+}
+
 pair<Model*, pair<Animation*, Animator*>> LoadModel(string pathToModel, bool moveable, float pos[3], float scale)
 {
+    PROFILE_FUNCTION();
+
     Model* model = new Model(convertPath(pathToModel), moveable);
     model->SetPosVec(pos);
     model->SetScaleVec(scale);
@@ -454,7 +1032,29 @@ pair<Model*, pair<Animation*, Animator*>> LoadModel(string pathToModel, bool mov
     // if animated 
     try
     {
+        // compressed and uncompressed clips of a file are kept apart, and so are different tolerances
+        string clipKey = pathToModel;
+        if (compressClips)
+            clipKey += "|compressed " + std::to_string(clipCompression.positionTolerance) + " " + std::to_string(clipCompression.rotationTolerance) +
+                       " " + std::to_string(clipCompression.scaleTolerance);
+        auto loaded = loadedClips.find(clipKey);
+        if (loaded != loadedClips.end())
+        {
+            Animator* animator = new Animator(loaded->second);
+            model->SetAnimated(true);
+            return make_pair(model, make_pair(loaded->second, animator));
+        }
+
         Animation* anim = new Animation(convertPath(pathToModel), model);
+        loadedClips[clipKey] = anim;
+        if (compressClips)
+        {
+            ClipCompressionReport report = anim->Compress(clipCompression);
+            clipReport.Add(report);
+            std::cout << "Clip " << pathToModel << ": " << report.keysBefore << " -> " << report.keysAfter << " keys, "
+                      << report.bytesBefore / 1024 << " -> " << report.bytesAfter / 1024 << " KB, max error "
+                      << report.maxPositionError << " / " << report.maxRotationError << " deg / " << report.maxScaleError << std::endl;
+        }
         Animator* animator = new Animator(anim);
         model->SetAnimated(true);
 
@@ -0,0 +1,8 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+// Number of global operator new calls so far. AllocationCounter.cpp replaces operator new for the whole test
+// executable, so tests take the difference around the code they check.
+long long GetAllocationCount();
+
+#endif
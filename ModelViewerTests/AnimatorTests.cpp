@@ -0,0 +1,219 @@
+#include "Tests.h"
+#include "AllocationCounter.h"
+#include "Animation.h"
+#include "Animator.h"
+
+#include <memory>
+
+namespace
+{
+    const int keyCount = 30;
+
+    // turns around the y axis over the clip, faster for larger speeds
+    aiNodeAnim* MakeChannel(const std::string& name, float speed)
+    {
+        aiNodeAnim* channel = new aiNodeAnim();
+        channel->mNodeName = aiString(name);
+        channel->mNumPositionKeys = 1;
+        channel->mPositionKeys = new aiVectorKey[1];
+        channel->mPositionKeys[0] = aiVectorKey(0, aiVector3D(0.0f, 0.1f, 0.0f));
+        channel->mNumRotationKeys = keyCount;
+        channel->mRotationKeys = new aiQuatKey[keyCount];
+        for (int k = 0; k < keyCount; ++k)
+            channel->mRotationKeys[k] = aiQuatKey(k, aiQuaternion(aiVector3D(0.0f, 1.0f, 0.0f), 0.05f * k * speed));
+        channel->mNumScalingKeys = 1;
+        channel->mScalingKeys = new aiVectorKey[1];
+        channel->mScalingKeys[0] = aiVectorKey(0, aiVector3D(1.0f));
+        return channel;
+    }
+
+    // a chain of bones below a root and helperCount helpers without bone matrices, clip keys every bone
+    struct Rig
+    {
+        aiNode* root = new aiNode("root");
+        aiAnimation clip;
+        std::map<std::string, BoneInfo> boneInfoMap;
+        int boneCount = 0;
+        int boneTotal;
+
+        explicit Rig(int boneTotal, int helperCount = 0) : boneTotal(boneTotal)
+        {
+            aiNode* parent = root;
+            for (int i = 0; i < helperCount; ++i)
+            {
+                aiNode* helper = new aiNode("helper_" + std::to_string(i));
+                parent->addChildren(1, &helper);
+                parent = helper;
+            }
+            for (int i = 0; i < boneTotal; ++i)
+            {
+                std::string name = "bone_" + std::to_string(i);
+                aiNode* node = new aiNode(name);
+                node->mTransformation = aiMatrix4x4(aiVector3D(1.0f), aiQuaternion(), aiVector3D(0.0f, 0.1f, 0.0f));
+                parent->addChildren(1, &node);
+                parent = node;
+
+                boneInfoMap[name].id = boneCount++;
+                boneInfoMap[name].offset = glm::mat4(1.0f);
+            }
+            MakeClip(clip);
+        }
+
+        // keys every bone, and the named helper if there is one
+        void MakeClip(aiAnimation& target, const std::string& helper = std::string())
+        {
+            int channelCount = boneTotal + (helper.empty() ? 0 : 1);
+            target.mDuration = keyCount - 1;
+            target.mTicksPerSecond = 30.0;
+            target.mNumChannels = channelCount;
+            target.mChannels = new aiNodeAnim*[channelCount];
+            for (int i = 0; i < boneTotal; ++i)
+                target.mChannels[i] = MakeChannel("bone_" + std::to_string(i), static_cast<float>(i + 1));
+            if (!helper.empty()) target.mChannels[boneTotal] = MakeChannel(helper, 0.5f);
+        }
+
+        ~Rig() { delete root; }
+
+        std::unique_ptr<Animation> MakeAnimation()
+        {
+            return std::make_unique<Animation>(&clip, root, boneInfoMap, boneCount);
+        }
+    };
+}
+
+// fading into a second clip with a masked layer on top must not touch the heap once the first frame set it up
+TEST(BlendingDoesNotAllocate)
+{
+    Rig rig(20);
+    std::unique_ptr<Animation> walk = rig.MakeAnimation();
+    std::unique_ptr<Animation> run = rig.MakeAnimation();
+    std::unique_ptr<Animation> wave = rig.MakeAnimation();
+
+    Animator animator(walk.get());
+    animator.CrossFade(run.get(), 10.0f);
+    CHECK(animator.AddLayer(wave.get(), 0.5f, walk->MakeMask("bone_10")) >= 0);
+    animator.UpdateAnimation(1.0f / 60.0f);
+
+    long long before = GetAllocationCount();
+    for (int f = 0; f < 100; ++f)
+        animator.UpdateAnimation(1.0f / 60.0f);
+    CHECK(GetAllocationCount() - before == 0);
+}
+
+// a layer with no weight leaves the pose of the playing clip alone
+TEST(LayerWithoutWeightKeepsPose)
+{
+    Rig rig(10);
+    std::unique_ptr<Animation> walk = rig.MakeAnimation();
+    std::unique_ptr<Animation> wave = rig.MakeAnimation();
+
+    Animator animator(walk.get());
+    animator.UpdateAnimation(0.4f);
+    std::vector<Affine> unblended = animator.GetFinalBoneMatrices();
+
+    CHECK(animator.AddLayer(wave.get(), 0.0f) >= 0);
+    animator.CalculateBoneTransforms();
+    const std::vector<Affine>& blended = animator.GetFinalBoneMatrices();
+    CHECK(blended.size() == unblended.size());
+    for (size_t i = 0; i < blended.size() && i < unblended.size(); ++i)
+        for (int r = 0; r < 3; ++r)
+            CHECK(glm::all(glm::lessThan(glm::abs(blended[i].rows[r] - unblended[i].rows[r]), glm::vec4(1e-4f))));
+}
+
+// layers need a clip of the same skeleton
+TEST(AddLayerRejectsOtherSkeleton)
+{
+    Rig rig(10);
+    Rig other(12);
+    std::unique_ptr<Animation> walk = rig.MakeAnimation();
+    std::unique_ptr<Animation> stranger = other.MakeAnimation();
+
+    Animator animator(walk.get());
+    CHECK(animator.AddLayer(stranger.get(), 1.0f) == -1);
+    CHECK(animator.AddLayer(nullptr, 1.0f) == -1);
+}
+
+// with reduced bones every animator keeps its own deep bones, sharing a pose through the cache doesn't change them
+TEST(PoseCacheKeepsReducedPosesOwn)
+{
+    Rig rig(10);
+    std::unique_ptr<Animation> walk = rig.MakeAnimation();
+
+    Animator first(walk.get());
+    Animator second(walk.get());
+    Animator uncached(walk.get());
+    first.UpdateAnimation(0.5f);
+    second.UpdateAnimation(0.2f);
+    uncached.UpdateAnimation(0.2f);
+
+    // both cached animators land on the same time
+    AnimationLod lod;
+    lod.maxDepth = 2;
+    PoseCache cache;
+    cache.Begin(1.0f / 30.0f);
+    first.UpdateAnimation(0.3f, lod, &cache);
+    second.UpdateAnimation(0.6f, lod, &cache);
+    uncached.UpdateAnimation(0.6f, lod);
+
+    const std::vector<Affine>& cached = second.GetFinalBoneMatrices();
+    const std::vector<Affine>& expected = uncached.GetFinalBoneMatrices();
+    CHECK(cached.size() == expected.size());
+    for (size_t i = 0; i < cached.size() && i < expected.size(); ++i)
+        for (int r = 0; r < 3; ++r)
+            CHECK(glm::all(glm::lessThan(glm::abs(cached[i].rows[r] - expected[i].rows[r]), glm::vec4(1e-4f))));
+}
+
+// two clips of one rig that key different helpers keep the same nodes once both registered their channels
+TEST(ClipsKeyingOtherHelpersShareSkeleton)
+{
+    Rig rig(6, 3);
+    aiAnimation turnFirst, turnSecond;
+    rig.MakeClip(turnFirst, "helper_0");
+    rig.MakeClip(turnSecond, "helper_2");
+    Animation::RegisterChannels(&turnFirst, rig.boneInfoMap, rig.boneCount);
+    Animation::RegisterChannels(&turnSecond, rig.boneInfoMap, rig.boneCount);
+
+    Animation first(&turnFirst, rig.root, rig.boneInfoMap, rig.boneCount);
+    Animation second(&turnSecond, rig.root, rig.boneInfoMap, rig.boneCount);
+    std::unique_ptr<Animation> plain = rig.MakeAnimation();
+    CHECK(first.SharesSkeleton(second));
+    CHECK(first.SharesSkeleton(*plain));
+    CHECK(first.FindNode("helper_0") >= 0);
+    CHECK(first.FindNode("helper_2") >= 0);
+
+    // the unkeyed helper folds, a mask on it still reaches the bones below
+    CHECK(first.FindNode("helper_1") < 0);
+    BoneMask mask = first.MakeMask("helper_1");
+    CHECK(mask.weights.size() == first.GetSkeleton().size());
+    CHECK(mask.weights[first.FindNode("helper_0")] == 0.0f);
+    CHECK(mask.weights[first.FindNode("helper_2")] == 1.0f);
+    CHECK(mask.weights[first.FindNode("bone_5")] == 1.0f);
+
+    Animator animator(&first);
+    CHECK(animator.AddLayer(&second, 0.5f) >= 0);
+}
+
+// switching to another rig drops the layers of the old one instead of blending them into the wrong skeleton
+TEST(PlayAnimationDropsLayersOfOtherSkeleton)
+{
+    Rig large(12);
+    Rig small(4);
+    std::unique_ptr<Animation> walk = large.MakeAnimation();
+    std::unique_ptr<Animation> wave = large.MakeAnimation();
+    std::unique_ptr<Animation> crawl = small.MakeAnimation();
+
+    Animator animator(walk.get());
+    CHECK(animator.AddLayer(wave.get(), 0.5f, walk->MakeMask("bone_6")) >= 0);
+    animator.UpdateAnimation(0.1f);
+
+    animator.PlayAnimation(crawl.get());
+    CHECK(!animator.IsBlending());
+    animator.UpdateAnimation(0.1f);
+    CHECK(animator.GetFinalBoneMatrices().size() >= static_cast<size_t>(small.boneCount));
+
+    // layers of the same rig survive a switch
+    animator.PlayAnimation(walk.get());
+    CHECK(animator.AddLayer(wave.get(), 0.5f, walk->MakeMask("bone_6")) >= 0);
+    animator.PlayAnimation(wave.get());
+    CHECK(animator.IsBlending());
+}
@@ -0,0 +1,49 @@
+#include "Tests.h"
+#include "MeshSimplifier.h"
+
+#include <cmath>
+
+namespace
+{
+    // a bumpy grid of size x size quads, scale multiplies every position
+    void MakeTerrain(int size, float scale, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        for (int y = 0; y <= size; ++y)
+        {
+            for (int x = 0; x <= size; ++x)
+            {
+                Vertex vertex{};
+                vertex.Position = glm::vec3(x, 0.3f * std::sin(x * 0.7f) * std::cos(y * 0.5f), y) * scale;
+                vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+                for (int i = 0; i < MAX_BONE_INFLUENCE; ++i) vertex.m_BoneIDs[i] = -1;
+                vertices.push_back(vertex);
+            }
+        }
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                unsigned int corner = y * (size + 1) + x;
+                indices.insert(indices.end(), { corner, corner + size + 1, corner + 1, corner + 1, corner + size + 1, corner + size + 2 });
+            }
+        }
+    }
+}
+
+// the error target is relative to the mesh, the same mesh in other units simplifies the same way
+TEST(SimplifyIgnoresModelScale)
+{
+    std::vector<Vertex> small, large;
+    std::vector<unsigned int> smallIndices, largeIndices;
+    MakeTerrain(24, 1.0f, small, smallIndices);
+    MakeTerrain(24, 100.0f, large, largeIndices);
+
+    float smallError = 0.0f, largeError = 0.0f;
+    std::vector<unsigned int> smallLod = MeshSimplifier::Simplify(small, smallIndices, smallIndices.size() / 4, 0.01f, &smallError);
+    std::vector<unsigned int> largeLod = MeshSimplifier::Simplify(large, largeIndices, largeIndices.size() / 4, 0.01f, &largeError);
+
+    CHECK(smallLod.size() < smallIndices.size());
+    CHECK(smallLod.size() == largeLod.size());
+    CHECK(std::abs(smallError - largeError) < 1e-4f);
+    CHECK(smallError <= 0.01f);
+}
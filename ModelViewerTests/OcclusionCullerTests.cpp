@@ -0,0 +1,71 @@
+#include "Tests.h"
+#include "OcclusionCuller.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+    // camera at the origin looking down -z
+    glm::mat4 ViewProjection()
+    {
+        return glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f) *
+               glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    AABB Box(const glm::vec3& center, float halfSize)
+    {
+        AABB box;
+        box.Expand(center - glm::vec3(halfSize));
+        box.Expand(center + glm::vec3(halfSize));
+        return box;
+    }
+
+    // a wall 10 units in front of the camera, wider than the view
+    void RasterizeWall(OcclusionCuller& culler, float halfWidth)
+    {
+        const glm::vec3 wall[4] = { { -halfWidth, -halfWidth, -10.0f }, { halfWidth, -halfWidth, -10.0f },
+                                    { halfWidth, halfWidth, -10.0f }, { -halfWidth, halfWidth, -10.0f } };
+        const unsigned int indices[6] = { 0, 1, 2, 0, 2, 3 };
+
+        culler.BeginFrame(ViewProjection());
+        culler.AddOccluder(wall, sizeof(glm::vec3), indices, 6, glm::mat4(1.0f));
+        culler.Rasterize();
+    }
+}
+
+TEST(OccluderHidesBoxBehindIt)
+{
+    OcclusionCuller culler;
+    RasterizeWall(culler, 50.0f);
+
+    CHECK(culler.GetOccluderCount() == 1);
+    CHECK(culler.GetTriangleCount() == 2);
+    CHECK(!culler.IsVisible(Box(glm::vec3(0.0f, 0.0f, -20.0f), 1.0f)));
+}
+
+TEST(BoxInFrontOfOccluderStaysVisible)
+{
+    OcclusionCuller culler;
+    RasterizeWall(culler, 50.0f);
+
+    CHECK(culler.IsVisible(Box(glm::vec3(0.0f, 0.0f, -5.0f), 1.0f)));
+}
+
+TEST(BoxBesideSmallOccluderStaysVisible)
+{
+    // the wall only covers the middle of the view, a box behind it but off to the side shows past its edge
+    OcclusionCuller culler;
+    RasterizeWall(culler, 2.0f);
+
+    CHECK(!culler.IsVisible(Box(glm::vec3(0.0f, 0.0f, -20.0f), 1.0f)));
+    CHECK(culler.IsVisible(Box(glm::vec3(15.0f, 0.0f, -20.0f), 1.0f)));
+}
+
+TEST(EmptyDepthBufferHidesNothing)
+{
+    OcclusionCuller culler;
+    culler.BeginFrame(ViewProjection());
+    culler.Rasterize();
+
+    CHECK(culler.IsVisible(Box(glm::vec3(0.0f, 0.0f, -20.0f), 1.0f)));
+}
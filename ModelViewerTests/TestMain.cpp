@@ -0,0 +1,38 @@
+#include "Tests.h"
+
+#include <iostream>
+#include <string>
+
+static int failures = 0;
+
+std::vector<TestCase>& GetTests()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+void ReportFailure(const char* file, int line, const char* condition)
+{
+    std::cout << "ERROR::TEST::CHECK_FAILED: " << file << ":" << line << ": " << condition << std::endl;
+    failures++;
+}
+
+// ModelViewerTests [name], runs every test or the ones whose name contains the argument
+int main(int argc, char** argv)
+{
+    std::string filter = argc >= 2 ? argv[1] : "";
+    int failedTests = 0, run = 0;
+    for (const TestCase& test : GetTests())
+    {
+        if (!filter.empty() && std::string(test.name).find(filter) == std::string::npos) continue;
+
+        int before = failures;
+        test.func();
+        run++;
+        bool passed = failures == before;
+        failedTests += !passed;
+        std::cout << (passed ? "  passed " : "  FAILED ") << test.name << std::endl;
+    }
+    std::cout << run - failedTests << " of " << run << " tests passed" << std::endl;
+    return failedTests == 0 ? 0 : 1;
+}
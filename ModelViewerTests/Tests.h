@@ -0,0 +1,30 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <vector>
+
+// Minimal test registry for the ModelViewerTests executable. TEST(name) defines a test, CHECK records a failure and
+// lets the test go on, the runner prints every failed check and returns non zero if there was one.
+struct TestCase
+{
+    const char* name;
+    void (*func)();
+};
+
+std::vector<TestCase>& GetTests();
+void ReportFailure(const char* file, int line, const char* condition);
+
+struct TestRegistrar
+{
+    TestRegistrar(const char* name, void (*func)()) { GetTests().push_back({ name, func }); }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistrar name##Registrar(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) ReportFailure(__FILE__, __LINE__, #condition); } while (false)
+
+#endif